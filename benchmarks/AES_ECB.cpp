@@ -37,13 +37,15 @@
 
 boost::timer::cpu_times time_AES_ECB(
     oclcrypto::System& system, oclcrypto::Device& device,
-    size_t keySize, size_t plaintextSize, unsigned int iterations)
+    size_t keySize, size_t plaintextSize, unsigned int iterations,
+    oclcrypto::AES_Base::Implementation implementation)
 {
     const std::vector<unsigned char> plaintext = generateRandomVector(plaintextSize);
     const std::vector<unsigned char> key = generateRandomVector(keySize);
 
     boost::timer::cpu_timer timer;
     oclcrypto::AES_ECB_Encrypt encrypt(system, device);
+    encrypt.setImplementation(implementation);
     encrypt.setKey(key.data(), key.size());
 
     for (size_t j = 0; j < iterations; ++j)
@@ -56,6 +58,30 @@ boost::timer::cpu_times time_AES_ECB(
     return timer.elapsed();
 }
 
+boost::timer::cpu_times time_AES_ECB_Decrypt(
+    oclcrypto::System& system, oclcrypto::Device& device,
+    size_t keySize, size_t ciphertextSize, unsigned int iterations,
+    oclcrypto::AES_Base::Implementation implementation)
+{
+    // decryption time doesn't depend on the ciphertext being valid
+    const std::vector<unsigned char> ciphertext = generateRandomVector(ciphertextSize);
+    const std::vector<unsigned char> key = generateRandomVector(keySize);
+
+    boost::timer::cpu_timer timer;
+    oclcrypto::AES_ECB_Decrypt decrypt(system, device);
+    decrypt.setImplementation(implementation);
+    decrypt.setKey(key.data(), key.size());
+
+    for (size_t j = 0; j < iterations; ++j)
+    {
+        decrypt.setCipherText(ciphertext.data(), ciphertext.size());
+        decrypt.execute(256);
+        auto lock = decrypt.getPlainText()->lockRead<unsigned char>();
+    }
+
+    return timer.elapsed();
+}
+
 void benchmark_AES_ECB(oclcrypto::System& system, size_t keySize, size_t plaintextSize, ResultsAggregator& results)
 {
     const unsigned int iterations = 100;
@@ -65,8 +91,24 @@ void benchmark_AES_ECB(oclcrypto::System& system, size_t keySize, size_t plainte
     for (size_t i = 0; i < system.getDeviceCount(); ++i)
     {
         oclcrypto::Device& device = system.getDevice(i);
-        const boost::timer::cpu_times times = time_AES_ECB(system, device, keySize, plaintextSize, iterations);
-        results.addResult("AES ECB " + std::to_string(keySize * 8) + "bit on " + device.getName(), plaintextSize, (times.wall * 0.001 * 0.001 * 0.001) / (double)iterations);
+
+        // all kernel implementations, the T-tables should win on most devices,
+        // bitslicing pays for its constant running time
+        boost::timer::cpu_times times = time_AES_ECB(system, device, keySize, plaintextSize, iterations, oclcrypto::AES_Base::BYTEWISE);
+        results.addResult("AES ECB " + std::to_string(keySize * 8) + "bit byte-wise on " + device.getName(), plaintextSize, (times.wall * 0.001 * 0.001 * 0.001) / (double)iterations);
+
+        times = time_AES_ECB(system, device, keySize, plaintextSize, iterations, oclcrypto::AES_Base::T_TABLES);
+        results.addResult("AES ECB " + std::to_string(keySize * 8) + "bit T-tables on " + device.getName(), plaintextSize, (times.wall * 0.001 * 0.001 * 0.001) / (double)iterations);
+
+        times = time_AES_ECB(system, device, keySize, plaintextSize, iterations, oclcrypto::AES_Base::BITSLICED);
+        results.addResult("AES ECB " + std::to_string(keySize * 8) + "bit bitsliced on " + device.getName(), plaintextSize, (times.wall * 0.001 * 0.001 * 0.001) / (double)iterations);
+
+        // the equivalent inverse cipher should keep up with encryption
+        times = time_AES_ECB_Decrypt(system, device, keySize, plaintextSize, iterations, oclcrypto::AES_Base::BYTEWISE);
+        results.addResult("AES ECB " + std::to_string(keySize * 8) + "bit byte-wise decryption on " + device.getName(), plaintextSize, (times.wall * 0.001 * 0.001 * 0.001) / (double)iterations);
+
+        times = time_AES_ECB_Decrypt(system, device, keySize, plaintextSize, iterations, oclcrypto::AES_Base::T_TABLES);
+        results.addResult("AES ECB " + std::to_string(keySize * 8) + "bit T-tables decryption on " + device.getName(), plaintextSize, (times.wall * 0.001 * 0.001 * 0.001) / (double)iterations);
     }
 }
 
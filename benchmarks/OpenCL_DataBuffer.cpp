@@ -44,11 +44,7 @@ boost::timer::cpu_times time_OpenCL_DataBuffer_ToDevice(
 
     for (size_t j = 0; j < iterations; ++j)
     {
-        {
-            auto lock = dataBuffer.lockWrite<unsigned char>();
-            for (size_t i = 0; i < bufferSize; ++i)
-                lock[i] = buffer[i];
-        }
+        dataBuffer.write(buffer.data(), bufferSize);
 
         // Just to make sure OpenCL isn't postponing the transfers
         CLErrorGuard(clFinish(device.getCLQueue()));
@@ -64,11 +60,7 @@ boost::timer::cpu_times time_OpenCL_DataBuffer_FromDevice(
     const std::vector<unsigned char> buffer = generateRandomVector(bufferSize);
 
     oclcrypto::DataBuffer& dataBuffer = device.allocateBuffer<unsigned char>(bufferSize, oclcrypto::DataBuffer::ReadWrite);
-    {
-        auto lock = dataBuffer.lockWrite<unsigned char>();
-        for (size_t i = 0; i < bufferSize; ++i)
-            lock[i] = buffer[i];
-    }
+    dataBuffer.write(buffer.data(), bufferSize);
 
     std::vector<unsigned char> readBuffer(bufferSize);
 
@@ -76,11 +68,7 @@ boost::timer::cpu_times time_OpenCL_DataBuffer_FromDevice(
 
     for (size_t j = 0; j < iterations; ++j)
     {
-        {
-            auto lock = dataBuffer.lockRead<unsigned char>();
-            for (size_t i = 0; i < bufferSize; ++i)
-                readBuffer[i] = lock[i];
-        }
+        dataBuffer.read(readBuffer.data(), bufferSize);
 
         // Just to make sure OpenCL isn't postponing the transfers
         CLErrorGuard(clFinish(device.getCLQueue()));
@@ -121,26 +121,22 @@ int main(int argc, char** argv)
         {
             oclcrypto::AES_ECB_Encrypt* algo = static_cast<oclcrypto::AES_ECB_Encrypt*>(alg);
             algo->setPlainText(&input_text[0], input_text.size());
-            algo->execute(device.suggestLocalWorkSize());
+            algo->execute();
 
-            const size_t size = algo->getCipherText()->getArraySize<char>();
             {
                 auto data = algo->getCipherText()->lockRead<char>();
-                for (size_t i = 0; i < size; ++i)
-                    output_text.push_back(data[i]);
+                output_text.insert(output_text.end(), data.begin(), data.end());
             }
         }
         else if (algorithm == "aes-ecb-dec")
         {
             oclcrypto::AES_ECB_Decrypt* algo = static_cast<oclcrypto::AES_ECB_Decrypt*>(alg);
             algo->setCipherText(&input_text[0], input_text.size());
-            algo->execute(device.suggestLocalWorkSize());
+            algo->execute();
 
-            const size_t size = algo->getPlainText()->getArraySize<char>();
             {
                 auto data = algo->getPlainText()->lockRead<char>();
-                for (size_t i = 0; i < size; ++i)
-                    output_text.push_back(data[i]);
+                output_text.insert(output_text.end(), data.begin(), data.end());
             }
         }
         else if (algorithm == "aes-ctr-enc")
@@ -148,13 +144,11 @@ int main(int argc, char** argv)
             oclcrypto::AES_CTR_Encrypt* algo = static_cast<oclcrypto::AES_CTR_Encrypt*>(alg);
             algo->setPlainText(&input_text[0], input_text.size());
             algo->setInitialCounter(reinterpret_cast<const unsigned char*>(ic.c_str()));
-            algo->execute(device.suggestLocalWorkSize());
+            algo->execute();
 
-            const size_t size = algo->getCipherText()->getArraySize<char>();
             {
                 auto data = algo->getCipherText()->lockRead<char>();
-                for (size_t i = 0; i < size; ++i)
-                    output_text.push_back(data[i]);
+                output_text.insert(output_text.end(), data.begin(), data.end());
             }
         }
         else if (algorithm == "aes-gcm-enc")
@@ -162,13 +156,11 @@ int main(int argc, char** argv)
             oclcrypto::AES_GCM_Encrypt* algo = static_cast<oclcrypto::AES_GCM_Encrypt*>(alg);
             algo->setPlainText(&input_text[0], input_text.size());
             algo->setInitialVector(reinterpret_cast<const unsigned char*>(ic.c_str()));
-            algo->execute(device.suggestLocalWorkSize());
+            algo->execute();
 
-            const size_t size = algo->getCipherText()->getArraySize<char>();
             {
                 auto data = algo->getCipherText()->lockRead<char>();
-                for (size_t i = 0; i < size; ++i)
-                    output_text.push_back(data[i]);
+                output_text.insert(output_text.end(), data.begin(), data.end());
             }
         }
 
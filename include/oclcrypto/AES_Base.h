@@ -27,6 +27,7 @@
 #define OCLCRYPTO_AES_BASE_H_
 
 #include "oclcrypto/ForwardDecls.h"
+#include <CL/cl.h>
 
 namespace oclcrypto
 {
@@ -48,8 +49,39 @@ class OCLCRYPTO_EXPORT AES_Base
          */
         static unsigned char* expandKeyRounds(const unsigned char* key, size_t keySize, unsigned short& rounds);
 
+        /**
+         * @brief Turns expanded key rounds into the decryption key schedule
+         *
+         * Applies InverseMixColumns to all but the first and the last round
+         * key, in place. The equivalent inverse cipher (FIPS-197 5.3.5) then
+         * runs with the same structure as the cipher.
+         *
+         * @param expandedKey Output of expandKeyRounds
+         * @param rounds Number of round keys, as filled by expandKeyRounds
+         */
+        static void invertKeyRounds(unsigned char* expandedKey, unsigned short rounds);
+
+        /**
+         * @brief How the kernels compute the rounds
+         */
+        enum Implementation
+        {
+            /// byte-wise S-box and Galois field lookups in constant memory
+            BYTEWISE = 0,
+            /// 32bit T-tables merging SubBytes, ShiftRows and MixColumns,
+            /// staged in local memory by each work-group
+            T_TABLES = 1,
+            /// 32 blocks per work-item as bit planes, logical operations
+            /// only, no secret dependent lookups, encryption only
+            BITSLICED = 2
+        };
+
     protected:
-        AES_Base(System& system, Device& device);
+        /**
+         * @param decryption Upload the decryption key schedule in setKey,
+         *                   see invertKeyRounds
+         */
+        AES_Base(System& system, Device& device, bool decryption = false);
         ~AES_Base();
 
     public:
@@ -66,12 +98,79 @@ class OCLCRYPTO_EXPORT AES_Base
             setKey(reinterpret_cast<const unsigned char*>(key), size);
         }
 
+        /**
+         * @brief Index of the Device command queue this cipher enqueues its work on
+         *
+         * Ciphers are spread over the queues of their device round-robin at
+         * construction, see Device::setQueueCount.
+         */
+        inline size_t getQueueIndex() const
+        {
+            return mQueueIndex;
+        }
+
+        /**
+         * @brief Binds this cipher to given command queue of its device
+         *
+         * Buffers of the cipher move to the new queue with the next execute.
+         */
+        void setQueueIndex(size_t idx);
+
+        /**
+         * @brief Selects the kernel implementation, BYTEWISE by default
+         *
+         * All produce the same output, the T-tables need 4 rather than 16
+         * lookups per column and round, benchmarks/AES_ECB compares them on
+         * a given device. BITSLICED runs in constant time but only ECB and
+         * CTR encryption have it, the other ciphers throw
+         * std::invalid_argument on execute. Takes effect with the next execute.
+         */
+        void setImplementation(Implementation implementation);
+
+        inline Implementation getImplementation() const
+        {
+            return mImplementation;
+        }
+
     protected:
+        /**
+         * @brief Returns the kernel of this cipher, it is created on first use
+         *
+         * The kernel comes from a program variant compiled for the current
+         * number of rounds, implementation and blocks per work-item of the
+         * device, it is kept until any of them changes. Expanded
+         * key and rounds are only bound again after the key has changed,
+         * callers have to bind the rest of the parameters themselves.
+         *
+         * @param name Name of the kernel function, has to be the same in all calls
+         * @param keyIndex Parameter index of the expanded key
+         * @param roundsIndex Parameter index of the number of rounds
+         */
+        Kernel& prepareKernel(const char* name, cl_uint keyIndex, cl_uint roundsIndex);
+
+        /**
+         * @brief Number of blocks one work-item of the prepared kernel processes
+         *
+         * Device::getBlocksPerWorkItem at the time the kernel was created, 32
+         * when bitsliced. Pass it as itemsPerWorkItem to Kernel::executeBounded.
+         */
+        size_t getBlocksPerWorkItem() const;
+
         System& mSystem;
         Device& mDevice;
+        size_t mQueueIndex;
 
+        const bool mDecryption;
         unsigned short mRounds;
         DataBuffer* mExpandedKey;
+        Implementation mImplementation;
+
+    private:
+        Kernel* mKernel;
+        bool mKernelKeyBound;
+        cl_uint mKernelRounds;
+        Implementation mKernelImplementation;
+        size_t mKernelBlocksPerWorkItem;
 };
 
 }
@@ -27,6 +27,7 @@
 #define OCLCRYPTO_BLOWFISH_BASE_H_
 
 #include "oclcrypto/ForwardDecls.h"
+#include <CL/cl.h>
 #include <cstdint>
 
 namespace oclcrypto
@@ -80,12 +81,59 @@ class OCLCRYPTO_EXPORT BLOWFISH_Base
             setKey(reinterpret_cast<const unsigned char*>(key), size);
         }
 
+        /**
+         * @brief Index of the Device command queue this cipher enqueues its work on
+         *
+         * Ciphers are spread over the queues of their device round-robin at
+         * construction, see Device::setQueueCount.
+         */
+        inline size_t getQueueIndex() const
+        {
+            return mQueueIndex;
+        }
+
+        /**
+         * @brief Binds this cipher to given command queue of its device
+         *
+         * Buffers of the cipher move to the new queue with the next execute.
+         */
+        void setQueueIndex(size_t idx);
+
     protected:
+        /**
+         * @brief Returns the kernel of this cipher, it is created on first use
+         *
+         * The kernel is kept until the blocks per work-item of the device
+         * change. P and SBoxes are only bound again after the key has changed,
+         * callers have to bind the rest of the parameters themselves.
+         *
+         * @param name Name of the kernel function, has to be the same in all calls
+         * @param pIndex Parameter index of the P array
+         * @param sboxesIndex Parameter index of the SBoxes
+         */
+        Kernel& prepareKernel(const char* name, cl_uint pIndex, cl_uint sboxesIndex);
+
+        /**
+         * @brief Number of blocks one work-item of the prepared kernel processes
+         *
+         * Pass it as itemsPerWorkItem to Kernel::executeBounded.
+         */
+        inline size_t getBlocksPerWorkItem() const
+        {
+            return mKernelBlocksPerWorkItem;
+        }
+
         System& mSystem;
         Device& mDevice;
+        size_t mQueueIndex;
 
         DataBuffer* mP;
         DataBuffer* mSBoxes;
+
+    private:
+        Kernel* mKernel;
+        bool mKernelKeyBound;
+        size_t mKernelBlocksPerWorkItem;
 };
 
 }
@@ -27,7 +27,10 @@
 #define OCLCRYPTO_BLOWFISH_ECB_H_
 
 #include "oclcrypto/ForwardDecls.h"
+#include "oclcrypto/Event.h"
+#include "oclcrypto/Kernel.h"
 #include "oclcrypto/BLOWFISH_Base.h"
+#include "oclcrypto/TextBuffers.h"
 
 namespace oclcrypto
 {
@@ -54,16 +57,60 @@ class OCLCRYPTO_EXPORT BLOWFISH_ECB_Encrypt : public BLOWFISH_Base
             setPlainText(reinterpret_cast<const unsigned char*>(plaintext), size);
         }
 
-        void execute(size_t localWorkSize);
+        /**
+         * @brief Uses given plaintext memory directly instead of copying it
+         *
+         * The memory has to stay valid and unmodified until the results
+         * have been read back or another plaintext is set. If the memory isn't
+         * aligned to Device::getMemBaseAddrAlign() we fall back to copying.
+         *
+         * @return true if the memory is used directly, false if it was copied
+         */
+        bool wrapPlainText(const unsigned char* plaintext, size_t size);
+
+        /**
+         * @brief Uses a range of an existing buffer as plaintext without copying
+         *
+         * A view of [offset, offset + size) of given buffer is created, many
+         * messages can therefore be staged in one big DataBuffer. The buffer
+         * has to outlive this object or the next call setting the plaintext.
+         *
+         * @param buffer Buffer of the same Device holding the plaintext
+         * @param offset Offset in bytes, a multiple of Device::getMemBaseAddrAlign()
+         * @param size Size in bytes, a multiple of 8
+         */
+        void setPlainTextView(DataBuffer& buffer, size_t offset, size_t size);
+
+        /**
+         * @brief Makes the ciphertext overwrite the plaintext in one shared buffer
+         *
+         * Only one DataBuffer::ReadWrite buffer is used for both, this halves
+         * the device memory needed for the encryption. Takes effect with the next
+         * call setting the plaintext. wrapPlainText always copies in this mode.
+         */
+        void setInPlace(bool inPlace);
+
+        inline bool isInPlace() const
+        {
+            return mTexts.isInPlace();
+        }
+
+        /**
+         * @brief Enqueues the encryption without waiting for it to finish
+         *
+         * @param localWorkSize See Kernel::execute, tuned size by default
+         * @param waitList Events that have to complete before the encryption starts
+         * @return Event signalling that the ciphertext is ready
+         */
+        Event execute(size_t localWorkSize = Kernel::TunedLocalWorkSize, const EventList& waitList = EventList());
 
         inline DataBuffer* getCipherText()
         {
-            return mCipherText;
+            return mTexts.getOutput();
         }
 
     private:
-        DataBuffer* mPlainText;
-        DataBuffer* mCipherText;
+        TextBuffers mTexts;
 };
 
 }
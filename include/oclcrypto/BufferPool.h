@@ -0,0 +1,144 @@
+/*
+ * Copyright (C) 2015 Martin Preisler <martin@preisler.me>
+ *
+ * This file is part of oclcrypto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef OCLCRYPTO_BUFFER_POOL_H_
+#define OCLCRYPTO_BUFFER_POOL_H_
+
+#include "oclcrypto/ForwardDecls.h"
+#include <CL/cl.h>
+
+#include <map>
+#include <mutex>
+
+namespace oclcrypto
+{
+
+/**
+ * @brief Recycles cl_mem objects of one Device to avoid clCreateBuffer churn
+ *
+ * Requested sizes are rounded up to a size class, by default the next power
+ * of two. Released memory objects are kept in the pool and handed out again
+ * to any DataBuffer of the same size class and memory flags, no matter which
+ * cipher instance allocated them originally.
+ *
+ * The pool never holds more than the high-water mark of unused memory, any
+ * memory released above that goes straight back to the OpenCL driver.
+ */
+class OCLCRYPTO_EXPORT BufferPool
+{
+    public:
+        BufferPool(Device& device);
+        ~BufferPool();
+
+        /**
+         * @brief Smallest size class used with power of two size classes
+         */
+        static const size_t MinimumSizeClass = 256;
+
+        /**
+         * @brief Default limit of unused memory held by the pool, in bytes
+         */
+        static const size_t DefaultHighWaterMark = 128 * 1024 * 1024;
+
+        /**
+         * @brief Gets a memory object with at least given size
+         *
+         * @param size Requested size in bytes
+         * @param flags OpenCL memory flags, have to match exactly for reuse
+         * @param capacity Will be filled with the real size of the memory object
+         */
+        cl_mem acquire(size_t size, cl_mem_flags flags, size_t& capacity);
+
+        /**
+         * @brief Returns a memory object previously retrieved via acquire
+         */
+        void release(cl_mem mem, size_t capacity, cl_mem_flags flags);
+
+        /**
+         * @brief Releases unused memory objects until at most targetBytes are held
+         */
+        void trim(size_t targetBytes = 0);
+
+        /**
+         * @brief Sets the maximum amount of unused memory kept in the pool
+         *
+         * Setting this to 0 effectively disables pooling. Memory over the new
+         * limit is released immediately.
+         */
+        void setHighWaterMark(size_t bytes);
+
+        size_t getHighWaterMark() const;
+
+        /**
+         * @brief Replaces the power of two size classes with custom ones
+         *
+         * @param sizeClasses Capacities in bytes, requests are rounded up to
+         *                    the smallest class that fits them. Requests
+         *                    larger than all classes are pooled by exact size.
+         *                    An empty vector restores power of two classes.
+         */
+        void setSizeClasses(const std::vector<size_t>& sizeClasses);
+
+        /**
+         * @brief Rounds given size up to its size class
+         */
+        size_t getSizeClass(size_t size) const;
+
+        /**
+         * @brief Amount of unused memory currently held by the pool, in bytes
+         */
+        size_t getCachedBytes() const;
+
+        /**
+         * @brief How many times did the pool have to call clCreateBuffer
+         */
+        size_t getDriverAllocationCount() const;
+
+        // noncopyable
+        BufferPool(const BufferPool&) = delete;
+        BufferPool& operator=(const BufferPool&) = delete;
+
+    private:
+        void trimLocked(size_t targetBytes);
+        size_t getSizeClassLocked(size_t size) const;
+
+        Device& mDevice;
+
+        mutable std::mutex mMutex;
+
+        typedef std::pair<size_t, cl_mem_flags> PoolKey;
+        typedef std::map<PoolKey, std::vector<cl_mem> > PoolMap;
+        PoolMap mPool;
+
+        std::vector<size_t> mSizeClasses;
+
+        size_t mHighWaterMark;
+        size_t mCachedBytes;
+        size_t mDriverAllocationCount;
+};
+
+}
+
+#endif
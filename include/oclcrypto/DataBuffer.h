@@ -27,8 +27,14 @@
 #define OCLCRYPTO_DATA_BUFFER_H_
 
 #include "oclcrypto/ForwardDecls.h"
+#include "oclcrypto/Event.h"
 #include <CL/cl.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <stdexcept>
 #include <string>
+#include <utility>
 
 namespace oclcrypto
 {
@@ -51,6 +57,31 @@ class OCLCRYPTO_EXPORT DataBuffer
          */
         DataBuffer(Device& device, const size_t size, unsigned short memFlags = ReadWrite);
 
+        /**
+         * @brief Creates a buffer backed by caller owned host memory
+         *
+         * @param size Size in bytes
+         * @param hostPtr Host memory that will be used via CL_MEM_USE_HOST_PTR,
+         *                nullptr makes this equivalent to the constructor above
+         *
+         * @note
+         * The memory pointed to by hostPtr has to stay valid for the whole
+         * lifetime of the DataBuffer. The OpenCL implementation may use it
+         * directly and avoid any intermediate copies.
+         */
+        DataBuffer(Device& device, const size_t size, unsigned short memFlags, void* hostPtr);
+
+        /**
+         * @brief Creates a view of the [offset, offset + size) byte range of parent
+         *
+         * The view is an OpenCL sub-buffer, it shares memory with the parent
+         * and can be used anywhere a DataBuffer is expected. Views of views
+         * are created directly over the outermost parent.
+         *
+         * @see createView
+         */
+        DataBuffer(DataBuffer& parent, const size_t offset, const size_t size);
+
         ~DataBuffer();
 
         Device& getDevice() const;
@@ -60,6 +91,100 @@ class OCLCRYPTO_EXPORT DataBuffer
             return mSize;
         }
 
+        inline unsigned short getMemFlags() const
+        {
+            return mMemFlags;
+        }
+
+        /**
+         * @brief Size of the underlying OpenCL memory object in bytes
+         *
+         * Memory objects come from the Device's BufferPool and are rounded
+         * up to its size classes, this is at least getSize().
+         */
+        inline size_t getCapacity() const
+        {
+            return mCapacity;
+        }
+
+        /**
+         * @brief Returns true if this buffer uses caller owned host memory
+         *
+         * Writing into such buffer writes into the caller's memory!
+         */
+        inline bool isWrappingHostMemory() const
+        {
+            return mHostPtr != nullptr;
+        }
+
+        /**
+         * @brief Returns true if this buffer is a view of another DataBuffer
+         */
+        inline bool isView() const
+        {
+            return mParent != nullptr;
+        }
+
+        /**
+         * @brief The buffer this view was created from, nullptr if this isn't a view
+         */
+        inline DataBuffer* getParent() const
+        {
+            return mParent;
+        }
+
+        /**
+         * @brief Offset of this view in bytes from the start of its parent
+         */
+        inline size_t getViewOffset() const
+        {
+            return mViewOffset;
+        }
+
+        /**
+         * @brief Number of live views created from this buffer
+         */
+        inline size_t getViewCount() const
+        {
+            return mViewCount;
+        }
+
+        /**
+         * @brief Index of the Device command queue all transfers of this buffer use
+         *
+         * Views start on the queue of their parent, other buffers on queue 0.
+         */
+        inline size_t getQueueIndex() const
+        {
+            return mQueueIndex;
+        }
+
+        /**
+         * @brief Moves this buffer to another command queue of its Device
+         *
+         * Kernels using the buffer should run on the same queue, that keeps
+         * them ordered with the transfers. If the buffer has already been used
+         * on its current queue, that queue is finished first.
+         *
+         * @see Device::setQueueCount
+         */
+        void setQueueIndex(size_t idx);
+
+        /**
+         * @brief Creates a view of the [offset, offset + size) byte range of this buffer
+         *
+         * This allows many small messages to live in one big allocation,
+         * each view can then be passed to a Kernel or a cipher on its own.
+         *
+         * @param offset Offset in bytes, it has to be a multiple of
+         *               Device::getMemBaseAddrAlign()
+         * @param size Size in bytes
+         *
+         * @note The returned buffer has to be deallocated using Device::deallocateBuffer
+         *       and all views have to be deallocated before this buffer.
+         */
+        DataBuffer& createView(const size_t offset, const size_t size);
+
         cl_mem getCLMem() const;
 
         const cl_mem* getCLMemPtr() const;
@@ -84,21 +209,206 @@ class OCLCRYPTO_EXPORT DataBuffer
         void* mapForWriting();
         void unmapForWriting(void* buffer);
 
+        /**
+         * @brief Maps only the [offset, offset + size) byte range for reading
+         *
+         * Only the mapped range has to be synchronized, reading back a small
+         * part of a big buffer is therefore much cheaper than mapping all of it.
+         * The returned pointer points to the first byte of the range.
+         */
+        void* mapForReading(size_t offset, size_t size);
+
+        /**
+         * @brief Maps only the [offset, offset + size) byte range for writing
+         *
+         * @see mapForReading(size_t, size_t)
+         */
+        void* mapForWriting(size_t offset, size_t size);
+
+        /**
+         * @brief Maps given byte range for writing, discarding its previous contents
+         *
+         * Uses CL_MAP_WRITE_INVALIDATE_REGION on OpenCL 1.2+ devices, this spares
+         * the implementation a device to host copy of data we are about to
+         * overwrite anyway. Falls back to CL_MAP_WRITE on older devices.
+         *
+         * @note Contents of the mapped memory are undefined, every byte of it
+         *       has to be written before unmapping!
+         */
+        void* mapForOverwriting(size_t offset, size_t size);
+        void* mapForOverwriting();
+
+        /**
+         * @brief Enqueues a non-blocking map for reading
+         *
+         * @param event Will be set to the event signalling that the mapping
+         *              finished. The returned pointer must not be dereferenced
+         *              before that!
+         * @param waitList Events that have to complete before the map starts
+         */
+        void* mapForReadingAsync(Event& event, const EventList& waitList = EventList());
+        void* mapForReadingAsync(size_t offset, size_t size, Event& event, const EventList& waitList = EventList());
+
+        /**
+         * @brief Enqueues a non-blocking map for writing
+         *
+         * @see mapForReadingAsync
+         */
+        void* mapForWritingAsync(Event& event, const EventList& waitList = EventList());
+        void* mapForWritingAsync(size_t offset, size_t size, Event& event, const EventList& waitList = EventList());
+        void* mapForOverwritingAsync(size_t offset, size_t size, Event& event, const EventList& waitList = EventList());
+
+        /**
+         * @brief Enqueues the unmap without waiting for it
+         *
+         * @param event Will be set to the event signalling completion of the unmap
+         * @param waitList Events that have to complete before the unmap starts
+         */
+        void unmapAsync(void* buffer, Event& event, const EventList& waitList = EventList());
+
+        /**
+         * @brief Copies size bytes from data to this buffer, starting at offset
+         *
+         * Uses clEnqueueWriteBuffer, the whole range is transferred in one go.
+         * The call blocks until data can be reused.
+         */
+        void write(const void* data, size_t size, size_t offset = 0);
+
+        /**
+         * @brief Copies size bytes starting at offset from this buffer to data
+         *
+         * Uses clEnqueueReadBuffer, the call blocks until data has been filled.
+         */
+        void read(void* data, size_t size, size_t offset = 0);
+
+        /**
+         * @brief Enqueues a non-blocking write
+         *
+         * @param event Will be set to the event signalling completion,
+         *              data must stay valid and unmodified until then
+         * @param waitList Events that have to complete before the transfer starts
+         */
+        void writeAsync(const void* data, size_t size, size_t offset, Event& event, const EventList& waitList = EventList());
+
+        /**
+         * @brief Enqueues a non-blocking read
+         *
+         * @param event Will be set to the event signalling completion,
+         *              data must not be accessed until then
+         * @param waitList Events that have to complete before the transfer starts
+         */
+        void readAsync(void* data, size_t size, size_t offset, Event& event, const EventList& waitList = EventList());
+
         template<typename T>
         DataBufferReadLock<T> lockRead();
 
         template<typename T>
         DataBufferWriteLock<T> lockWrite();
 
+        /**
+         * @brief Locks count elements starting at element offset for reading
+         *
+         * Index 0 of the returned lock is the element at offset.
+         */
+        template<typename T>
+        DataBufferReadLock<T> lockRead(size_t offset, size_t count);
+
+        /**
+         * @brief Locks count elements starting at element offset for writing
+         *
+         * Index 0 of the returned lock is the element at offset.
+         */
+        template<typename T>
+        DataBufferWriteLock<T> lockWrite(size_t offset, size_t count);
+
+        /**
+         * @brief Locks the buffer for writing, its previous contents are discarded
+         *
+         * Use this when the whole locked range gets overwritten, the lock
+         * doesn't have to synchronize the old data to the host.
+         *
+         * @see mapForOverwriting
+         */
+        template<typename T>
+        DataBufferWriteLock<T> lockOverwrite();
+
+        template<typename T>
+        DataBufferWriteLock<T> lockOverwrite(size_t offset, size_t count);
+
+        /**
+         * @brief Locks the buffer for reading without stalling the host thread
+         *
+         * The returned lock blocks only when its data is first accessed.
+         */
+        template<typename T>
+        DataBufferReadLock<T> lockReadAsync();
+
+        /**
+         * @brief Locks the buffer for writing without stalling the host thread
+         *
+         * The returned lock blocks only when its data is first accessed.
+         */
+        template<typename T>
+        DataBufferWriteLock<T> lockWriteAsync();
+
+        template<typename T>
+        DataBufferReadLock<T> lockReadAsync(size_t offset, size_t count);
+
+        template<typename T>
+        DataBufferWriteLock<T> lockWriteAsync(size_t offset, size_t count);
+
         // noncopyable
         DataBuffer(const DataBuffer&) = delete;
         DataBuffer& operator=(const DataBuffer&) = delete;
 
     private:
+        friend class Device;
+        friend class Kernel;
+
+        /**
+         * @brief Returns the queue to enqueue commands on and marks the buffer used
+         */
+        cl_command_queue getCLQueue();
+
+        /**
+         * @brief Remembers given command as the last one using this buffer on its queue
+         *
+         * Views record their commands in their parent, they share its memory.
+         * The event is retained, the caller keeps its own reference.
+         */
+        void recordLastEvent(cl_event event);
+
+        /**
+         * @brief Blocks until the recorded commands using this buffer complete
+         */
+        void waitForLastEvents();
+
+        void* map(cl_map_flags flags, size_t offset, size_t size, bool blocking, cl_event* event,
+                  const EventList& waitList = EventList());
+        void unmap(void* buffer, cl_event* event, const EventList& waitList = EventList());
+        void checkRange(size_t offset, size_t size) const;
+        cl_map_flags getOverwriteMapFlags() const;
+
         Device& mDevice;
         const size_t mSize;
         const unsigned short mMemFlags;
+        void* const mHostPtr;
+
+        DataBuffer* const mParent;
+        const size_t mViewOffset;
+        size_t mViewCount;
+
+        size_t mQueueIndex;
+        // whether any command using this buffer has been enqueued on its queue,
+        // atomic because views owned by other threads read it of their parent
+        std::atomic<bool> mQueueUsed;
+
+        // last command using the memory per queue index, queues are in-order
+        std::map<size_t, Event> mLastEvents;
+        std::mutex mLastEventsMutex;
 
+        size_t mCapacity;
+        cl_mem_flags mCLMemFlags;
         cl_mem mCLMem;
 };
 
@@ -106,25 +416,77 @@ template<typename T>
 class DataBufferReadLock
 {
     public:
-        inline DataBufferReadLock(DataBuffer& buffer):
+        /**
+         * @param async If true the mapping is enqueued and we only block
+         *              once the data is first accessed
+         */
+        inline DataBufferReadLock(DataBuffer& buffer, bool async = false):
+            DataBufferReadLock(buffer, 0, buffer.getArraySize<T>(), async)
+        {}
+
+        /**
+         * @param offset Index of the first locked element
+         * @param count Number of locked elements
+         */
+        inline DataBufferReadLock(DataBuffer& buffer, size_t offset, size_t count, bool async = false):
             mBuffer(buffer),
-            mData(nullptr)
+            mData(nullptr),
+            mCount(count)
         {
-            mData = reinterpret_cast<T*>(mBuffer.mapForReading());
+            mData = reinterpret_cast<T*>(async ?
+                mBuffer.mapForReadingAsync(offset * sizeof(T), count * sizeof(T), mMapEvent) :
+                mBuffer.mapForReading(offset * sizeof(T), count * sizeof(T)));
         }
 
         inline ~DataBufferReadLock()
         {
-            mBuffer.unmapForReading(mData);
+            if (mData)
+                mBuffer.unmapForReading(mData);
         }
 
+        /**
+         * @brief Number of locked elements
+         */
         inline size_t size() const
         {
-            return mBuffer.getArraySize<T>();
+            return mCount;
+        }
+
+        /**
+         * @brief Pointer to the first locked element, the elements are contiguous
+         */
+        inline const T* data() const
+        {
+            wait();
+            return mData;
+        }
+
+        inline const T* begin() const
+        {
+            return data();
+        }
+
+        inline const T* end() const
+        {
+            return data() + mCount;
+        }
+
+        /**
+         * @brief Blocks until the mapped data is accessible
+         */
+        inline void wait() const
+        {
+            if (mMapEvent.getCLEvent())
+            {
+                mMapEvent.wait();
+                mMapEvent = Event();
+            }
         }
 
         inline const T& operator[](const size_t idx) const
         {
+            wait();
+
 #ifndef NDEBUG
             if (idx >= size())
                 throw std::out_of_range("Index out of bounds");
@@ -137,8 +499,12 @@ class DataBufferReadLock
         // but move constructible!
         DataBufferReadLock(DataBufferReadLock&& other):
             mBuffer(other.mBuffer),
-            mData(other.mData)
-        {}
+            mData(other.mData),
+            mCount(other.mCount),
+            mMapEvent(std::move(other.mMapEvent))
+        {
+            other.mData = nullptr;
+        }
 
         DataBufferReadLock(const DataBufferReadLock&) = delete;
         DataBufferReadLock& operator=(const DataBufferReadLock&) = delete;
@@ -146,6 +512,8 @@ class DataBufferReadLock
     private:
         DataBuffer& mBuffer;
         T* mData;
+        const size_t mCount;
+        mutable Event mMapEvent;
 };
 
 template<typename T>
@@ -154,26 +522,108 @@ DataBufferReadLock<T> DataBuffer::lockRead()
     return DataBufferReadLock<T>(*this);
 }
 
+template<typename T>
+DataBufferReadLock<T> DataBuffer::lockReadAsync()
+{
+    return DataBufferReadLock<T>(*this, true);
+}
+
+template<typename T>
+DataBufferReadLock<T> DataBuffer::lockRead(size_t offset, size_t count)
+{
+    return DataBufferReadLock<T>(*this, offset, count);
+}
+
+template<typename T>
+DataBufferReadLock<T> DataBuffer::lockReadAsync(size_t offset, size_t count)
+{
+    return DataBufferReadLock<T>(*this, offset, count, true);
+}
+
 template<typename T>
 class DataBufferWriteLock
 {
     public:
-        inline DataBufferWriteLock(DataBuffer& buffer):
+        /**
+         * @param async If true the mapping is enqueued and we only block
+         *              once the data is first accessed
+         */
+        inline DataBufferWriteLock(DataBuffer& buffer, bool async = false, bool discard = false):
+            DataBufferWriteLock(buffer, 0, buffer.getArraySize<T>(), async, discard)
+        {}
+
+        /**
+         * @param offset Index of the first locked element
+         * @param count Number of locked elements
+         * @param discard If true previous contents of the locked range are
+         *                undefined and have to be overwritten completely
+         */
+        inline DataBufferWriteLock(DataBuffer& buffer, size_t offset, size_t count, bool async = false, bool discard = false):
             mBuffer(buffer),
-            mData(nullptr)
+            mData(nullptr),
+            mCount(count)
         {
-            mData = reinterpret_cast<T*>(mBuffer.mapForWriting());
+            if (discard)
+                mData = reinterpret_cast<T*>(async ?
+                    mBuffer.mapForOverwritingAsync(offset * sizeof(T), count * sizeof(T), mMapEvent) :
+                    mBuffer.mapForOverwriting(offset * sizeof(T), count * sizeof(T)));
+            else
+                mData = reinterpret_cast<T*>(async ?
+                    mBuffer.mapForWritingAsync(offset * sizeof(T), count * sizeof(T), mMapEvent) :
+                    mBuffer.mapForWriting(offset * sizeof(T), count * sizeof(T)));
         }
 
         inline ~DataBufferWriteLock()
         {
-            mBuffer.unmapForWriting(mData);
+            if (mData)
+                mBuffer.unmapForWriting(mData);
+        }
+
+        /**
+         * @brief Number of locked elements
+         */
+        inline size_t size() const
+        {
+            return mCount;
+        }
+
+        /**
+         * @brief Pointer to the first locked element, the elements are contiguous
+         */
+        inline T* data()
+        {
+            wait();
+            return mData;
+        }
+
+        inline T* begin()
+        {
+            return data();
+        }
+
+        inline T* end()
+        {
+            return data() + mCount;
+        }
+
+        /**
+         * @brief Blocks until the mapped data is accessible
+         */
+        inline void wait() const
+        {
+            if (mMapEvent.getCLEvent())
+            {
+                mMapEvent.wait();
+                mMapEvent = Event();
+            }
         }
 
         inline T& operator[](const size_t idx)
         {
+            wait();
+
 #ifndef NDEBUG
-            if (idx >= mBuffer.getArraySize<T>())
+            if (idx >= mCount)
                 throw std::out_of_range("Index out of bounds");
 #endif
 
@@ -182,8 +632,10 @@ class DataBufferWriteLock
 
         inline const T& operator[](const size_t idx) const
         {
+            wait();
+
 #ifndef NDEBUG
-            if (idx >= mBuffer.getArraySize<T>())
+            if (idx >= mCount)
                 throw std::out_of_range("Index out of bounds");
 #endif
 
@@ -194,8 +646,12 @@ class DataBufferWriteLock
         // but move constructible!
         DataBufferWriteLock(DataBufferWriteLock&& other):
             mBuffer(other.mBuffer),
-            mData(other.mData)
-        {}
+            mData(other.mData),
+            mCount(other.mCount),
+            mMapEvent(std::move(other.mMapEvent))
+        {
+            other.mData = nullptr;
+        }
 
         DataBufferWriteLock(const DataBufferWriteLock&) = delete;
         DataBufferWriteLock& operator=(const DataBufferWriteLock&) = delete;
@@ -203,6 +659,8 @@ class DataBufferWriteLock
     private:
         DataBuffer& mBuffer;
         T* mData;
+        const size_t mCount;
+        mutable Event mMapEvent;
 };
 
 template<typename T>
@@ -211,6 +669,36 @@ DataBufferWriteLock<T> DataBuffer::lockWrite()
     return DataBufferWriteLock<T>(*this);
 }
 
+template<typename T>
+DataBufferWriteLock<T> DataBuffer::lockWriteAsync()
+{
+    return DataBufferWriteLock<T>(*this, true);
+}
+
+template<typename T>
+DataBufferWriteLock<T> DataBuffer::lockWrite(size_t offset, size_t count)
+{
+    return DataBufferWriteLock<T>(*this, offset, count);
+}
+
+template<typename T>
+DataBufferWriteLock<T> DataBuffer::lockOverwrite()
+{
+    return DataBufferWriteLock<T>(*this, false, true);
+}
+
+template<typename T>
+DataBufferWriteLock<T> DataBuffer::lockOverwrite(size_t offset, size_t count)
+{
+    return DataBufferWriteLock<T>(*this, offset, count, false, true);
+}
+
+template<typename T>
+DataBufferWriteLock<T> DataBuffer::lockWriteAsync(size_t offset, size_t count)
+{
+    return DataBufferWriteLock<T>(*this, offset, count, true);
+}
+
 }
 
 #endif
@@ -28,8 +28,13 @@
 
 #include "oclcrypto/ForwardDecls.h"
 #include "oclcrypto/DataBuffer.h"
+#include "oclcrypto/BufferPool.h"
 
 #include <CL/cl.h>
+#include <atomic>
+#include <map>
+#include <mutex>
+#include <stdexcept>
 #include <string>
 
 namespace oclcrypto
@@ -41,8 +46,28 @@ enum Endianess
     E_BIG_ENDIAN
 };
 
+/**
+ * @brief Thrown when an allocation would exceed the memory budget of a Device
+ *
+ * Unlike CL_MEM_OBJECT_ALLOCATION_FAILURE this is raised before the OpenCL
+ * implementation is asked for the memory.
+ */
+class OCLCRYPTO_EXPORT DeviceMemoryBudgetExceeded : public std::runtime_error
+{
+    public:
+        DeviceMemoryBudgetExceeded(const std::string& message, size_t requestedBytes, size_t availableBytes);
+
+        const size_t mRequestedBytes;
+        const size_t mAvailableBytes;
+};
+
 /**
  * @brief Represents one OpenCL device with a distinct cl_device_id
+ *
+ * Creating and destroying programs and buffers and the memory accounting
+ * may be used from multiple threads at once. Configuration of the queues
+ * (setQueueCount, setProfilingEnabled) is not synchronized, it has to be
+ * done before the device is shared between threads.
  */
 class OCLCRYPTO_EXPORT Device
 {
@@ -52,9 +77,38 @@ class OCLCRYPTO_EXPORT Device
 
         std::string getName() const;
 
+        /**
+         * @brief CL_DEVICE_VERSION, "OpenCL <major>.<minor> <vendor specific>"
+         */
+        std::string getVersion() const;
+
+        /**
+         * @brief CL_DRIVER_VERSION, the version of the OpenCL implementation
+         */
+        std::string getDriverVersion() const;
+
         Endianess getEndianess() const;
 
-        Program& createProgram(const std::string& source);
+        /**
+         * @brief Checks whether the device reports at least given OpenCL version
+         *
+         * The version is parsed from CL_DEVICE_VERSION once at construction.
+         */
+        inline bool supportsCLVersion(unsigned int major, unsigned int minor) const
+        {
+            return mCLVersionMajor > major || (mCLVersionMajor == major && mCLVersionMinor >= minor);
+        }
+
+        /**
+         * @param binaryCache If not null the program binary is loaded from and
+         *                    stored to this cache
+         * @param extraBuildOptions Appended to the default build options
+         *
+         * @note Programs may be created and destroyed from multiple threads at
+         *       once, the build itself runs without holding any lock.
+         */
+        Program& createProgram(const std::string& source, ProgramBinaryCache* binaryCache = nullptr,
+                               const std::string& extraBuildOptions = "");
         void destroyProgram(Program& program);
 
         inline cl_device_id getCLDeviceID() const
@@ -67,9 +121,56 @@ class OCLCRYPTO_EXPORT Device
             return mCLContext;
         }
 
-        inline cl_command_queue getCLQueue() const
+        /**
+         * @brief Returns one of the in-order command queues of this device
+         *
+         * @param idx Queue index, wraps around the number of queues so that
+         *            an index stays usable after setQueueCount lowered the count
+         */
+        inline cl_command_queue getCLQueue(size_t idx = 0) const
+        {
+            return mCLQueues[idx % mCLQueues.size()];
+        }
+
+        inline size_t getQueueCount() const
+        {
+            return mCLQueues.size();
+        }
+
+        /**
+         * @brief Sets how many in-order command queues the device uses
+         *
+         * Commands in different queues may overlap, e.g. the upload of one batch
+         * with the kernel of another and the readback of a third one. Ciphers
+         * are spread over the queues round-robin, see acquireQueue.
+         *
+         * All queues are finished and recreated. There is just one queue
+         * by default.
+         */
+        void setQueueCount(size_t count);
+
+        /**
+         * @brief Returns the index of the next queue in round-robin order
+         */
+        size_t acquireQueue();
+
+        /**
+         * @brief Blocks until all commands of given queue have finished
+         */
+        void finishQueue(size_t idx);
+
+        /**
+         * @brief Enables the timestamps of Event, see Event::getStartTime
+         *
+         * The command queues are recreated with CL_QUEUE_PROFILING_ENABLE after
+         * all commands enqueued so far have finished. Profiling adds a little
+         * overhead to every command, it is disabled by default.
+         */
+        void setProfilingEnabled(bool enabled);
+
+        inline bool isProfilingEnabled() const
         {
-            return mCLQueue;
+            return mProfilingEnabled;
         }
 
         DataBuffer& allocateBufferRaw(const size_t size, const unsigned short memFlags = DataBuffer::ReadWrite);
@@ -80,12 +181,225 @@ class OCLCRYPTO_EXPORT Device
             return allocateBufferRaw(count * sizeof(T), memFlags);
         }
 
+        /**
+         * @brief Creates a DataBuffer that uses given host memory directly
+         *
+         * @param hostPtr Caller owned memory, has to outlive the returned buffer
+         * @param size Size in bytes
+         *
+         * @see canWrapHostMemory
+         * @note The returned buffer has to be deallocated using deallocateBuffer
+         */
+        DataBuffer& wrapHostMemory(void* hostPtr, const size_t size, const unsigned short memFlags = DataBuffer::ReadWrite);
+
+        /**
+         * @brief Creates a view of the [offset, offset + size) byte range of parent
+         *
+         * @see DataBuffer::createView
+         * @note The returned buffer has to be deallocated using deallocateBuffer
+         */
+        DataBuffer& createBufferView(DataBuffer& parent, const size_t offset, const size_t size);
+
+        /**
+         * @note
+         * The memory of deallocated buffers is recycled by the BufferPool
+         * and reused by later allocations of a similar size.
+         * Buffers with live views can't be deallocated, deallocate the views first.
+         */
         void deallocateBuffer(DataBuffer& buffer);
 
+        /**
+         * @brief Pool recycling OpenCL memory objects of this device
+         *
+         * Use it to tweak size classes and the high-water mark or to trim
+         * unused memory.
+         */
+        inline BufferPool& getBufferPool()
+        {
+            return mBufferPool;
+        }
+
+        /**
+         * @brief Minimum alignment (in bytes) of host memory wrapped by DataBuffers
+         *
+         * This is CL_DEVICE_MEM_BASE_ADDR_ALIGN converted to bytes. Wrapping
+         * memory that is not aligned like this forces the OpenCL implementation
+         * to make a copy, which defeats the purpose.
+         */
+        inline size_t getMemBaseAddrAlign() const
+        {
+            return mMemBaseAddrAlign;
+        }
+
+        /**
+         * @brief Checks whether given host memory can be wrapped without copying
+         */
+        bool canWrapHostMemory(const void* hostPtr, const size_t size) const;
+
+        /**
+         * @brief CL_DEVICE_GLOBAL_MEM_SIZE in bytes
+         */
+        inline size_t getGlobalMemSize() const
+        {
+            return mGlobalMemSize;
+        }
+
+        /**
+         * @brief CL_DEVICE_MAX_MEM_ALLOC_SIZE in bytes, no single DataBuffer can be bigger
+         */
+        inline size_t getMaxMemAllocSize() const
+        {
+            return mMaxMemAllocSize;
+        }
+
+        /**
+         * @brief Limits how much memory live DataBuffers can occupy, in bytes
+         *
+         * Allocations that would exceed the budget throw DeviceMemoryBudgetExceeded.
+         * Unused memory of the BufferPool is trimmed after each allocation so that
+         * it fits into what the live DataBuffers leave of the budget.
+         * The budget defaults to and is capped at getGlobalMemSize().
+         */
+        void setMemoryBudget(size_t bytes);
+
+        inline size_t getMemoryBudget() const
+        {
+            std::lock_guard<std::mutex> lock(mDataBuffersMutex);
+            return mMemoryBudget;
+        }
+
+        /**
+         * @brief Memory occupied by live DataBuffers in bytes
+         *
+         * Buffers are accounted with their capacity, views don't occupy any
+         * memory of their own. Unused memory cached in the BufferPool is
+         * reported by BufferPool::getCachedBytes.
+         */
+        inline size_t getLiveBytes() const
+        {
+            std::lock_guard<std::mutex> lock(mDataBuffersMutex);
+            return mLiveBytes;
+        }
+
+        /**
+         * @brief Highest getLiveBytes() seen since creation or the last resetPeakBytes()
+         */
+        inline size_t getPeakBytes() const
+        {
+            std::lock_guard<std::mutex> lock(mDataBuffersMutex);
+            return mPeakBytes;
+        }
+
+        inline void resetPeakBytes()
+        {
+            std::lock_guard<std::mutex> lock(mDataBuffersMutex);
+            mPeakBytes = mLiveBytes;
+        }
+
+        /**
+         * @brief Number of live DataBuffers, views included
+         */
+        inline size_t getLiveBufferCount() const
+        {
+            std::lock_guard<std::mutex> lock(mDataBuffersMutex);
+            return mDataBuffers.size();
+        }
+
+        /**
+         * @brief Total number of DataBuffers allocated since creation, views excluded
+         */
+        inline size_t getAllocationCount() const
+        {
+            std::lock_guard<std::mutex> lock(mDataBuffersMutex);
+            return mAllocationCount;
+        }
+
+        /**
+         * @brief Relative throughput of this device, higher is faster
+         *
+         * Estimated at construction as compute units * clock in MHz * a device
+         * type factor (GPU 8, accelerator 4, CPU 1), GPU compute units run many
+         * more work items at once than CPU cores. System::calibrateDevices
+         * replaces the estimate with measured throughput.
+         *
+         * @note Capacities are only comparable between devices of one System
+         */
         unsigned int getCapacity() const;
 
+        /**
+         * @brief Overrides the capacity, e.g. with a measured value
+         */
+        void setCapacity(unsigned int capacity);
+
+        /**
+         * @brief CL_DEVICE_TYPE, e.g. CL_DEVICE_TYPE_GPU
+         */
+        cl_device_type getType() const;
+
+        /**
+         * @brief CL_DEVICE_MAX_COMPUTE_UNITS
+         */
+        unsigned int getMaxComputeUnits() const;
+
+        /**
+         * @brief CL_DEVICE_MAX_CLOCK_FREQUENCY in MHz
+         */
+        unsigned int getMaxClockFrequency() const;
+
+        /**
+         * @brief Number of blocks each work-item of the cipher kernels processes
+         *
+         * Programs are built with it as BLOCKS_PER_ITEM, see
+         * System::getProgramFromCache. More blocks per work-item amortize the
+         * per work-item setup and let each work-item have several loads in
+         * flight, fewer leave more work-items to hide latency with. Estimated
+         * at construction, 8 on CPUs and 2 on other devices.
+         */
+        size_t getBlocksPerWorkItem() const;
+
+        /**
+         * @brief Overrides the number of blocks per work-item
+         *
+         * Ciphers pick the new number up with their next execute, that builds
+         * another program variant.
+         *
+         * @param blocks 1 to MaxBlocksPerWorkItem
+         */
+        void setBlocksPerWorkItem(size_t blocks);
+
+        /// the kernels keep that many blocks in private memory at once
+        static const size_t MaxBlocksPerWorkItem = 16;
+
+        /**
+         * @brief Local work size used for kernels that haven't been tuned
+         *
+         * Returns 0, the OpenCL implementation then picks the size itself.
+         */
         unsigned int suggestLocalWorkSize() const;
 
+        /**
+         * @brief Local work size tuned for given kernel, see WorkGroupTuner
+         *
+         * @param kernelName Name of the kernel function
+         * @param variant Extra build options of the program, see Program::getVariant
+         * @return The tuned size or suggestLocalWorkSize() if there is none
+         */
+        size_t suggestLocalWorkSize(const std::string& kernelName, const std::string& variant = "") const;
+
+        /**
+         * @brief Kernel name and program variant to local work size
+         */
+        typedef std::map<std::pair<std::string, std::string>, size_t> LocalWorkSizeMap;
+
+        void setTunedLocalWorkSize(const std::string& kernelName, const std::string& variant, size_t size);
+
+        LocalWorkSizeMap getTunedLocalWorkSizes() const;
+
+        /**
+         * @brief Replaces all tuned local work sizes
+         */
+        void setTunedLocalWorkSizes(const LocalWorkSizeMap& sizes);
+
         // noncopyable
         Device(const Device&) = delete;
         Device& operator=(const Device&) = delete;
@@ -94,13 +408,54 @@ class OCLCRYPTO_EXPORT Device
         cl_platform_id mCLPlatformID;
         cl_device_id mCLDeviceID;
         cl_context mCLContext;
-        cl_command_queue mCLQueue;
+        void createQueues(size_t count, bool profilingEnabled);
+        void releaseQueues();
+
+        std::vector<cl_command_queue> mCLQueues;
+        std::atomic<size_t> mNextQueue;
+        bool mProfilingEnabled;
+
+        size_t mMemBaseAddrAlign;
+        unsigned int mCLVersionMajor;
+        unsigned int mCLVersionMinor;
 
         typedef std::vector<Program*> ProgramVector;
         ProgramVector mPrograms;
+        std::mutex mProgramsMutex;
 
         typedef std::vector<DataBuffer*> DataBufferVector;
         DataBufferVector mDataBuffers;
+        // guards mDataBuffers and the memory accounting below
+        mutable std::mutex mDataBuffersMutex;
+
+        BufferPool mBufferPool;
+
+        /**
+         * @brief Accounts size bytes as live before the buffer is created
+         *
+         * The memory is reserved under the lock but the buffer is created
+         * without it, concurrent allocations don't wait for each other's
+         * clCreateBuffer calls.
+         */
+        void reserveMemory(size_t size);
+        void releaseMemory(size_t size);
+        void registerBuffer(DataBuffer* buffer, size_t reservedSize);
+
+        size_t mGlobalMemSize;
+        size_t mMaxMemAllocSize;
+        size_t mMemoryBudget;
+
+        unsigned int estimateCapacity() const;
+
+        std::atomic<unsigned int> mCapacity;
+        std::atomic<size_t> mBlocksPerWorkItem;
+
+        LocalWorkSizeMap mTunedLocalWorkSizes;
+        mutable std::mutex mTunedLocalWorkSizesMutex;
+
+        size_t mLiveBytes;
+        size_t mPeakBytes;
+        size_t mAllocationCount;
 };
 
 }
@@ -0,0 +1,143 @@
+/*
+ * Copyright (C) 2015 Martin Preisler <martin@preisler.me>
+ *
+ * This file is part of oclcrypto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef OCLCRYPTO_EVENT_H_
+#define OCLCRYPTO_EVENT_H_
+
+#include "oclcrypto/ForwardDecls.h"
+#include <CL/cl.h>
+
+#include <vector>
+
+namespace oclcrypto
+{
+
+/**
+ * @brief RAII wrapper of an OpenCL event
+ *
+ * Events are returned by asynchronous operations and signal their completion.
+ * Copies share the same underlying cl_event, it is released once the last
+ * copy is destroyed. A default constructed Event is considered complete.
+ *
+ * An operation enqueued as several commands on one in-order queue is
+ * represented by the events of its first and last command. Completion
+ * follows the last one, profiling spans from the first to the last.
+ */
+class OCLCRYPTO_EXPORT Event
+{
+    public:
+        Event();
+
+        /**
+         * @param event OpenCL event, ownership is taken over, it is not retained
+         */
+        explicit Event(cl_event event);
+
+        /**
+         * @param first Event of the first command, null if there is only one
+         * @param last Event of the last command, the operation completes with it
+         *
+         * Ownership of both is taken over, they are not retained.
+         */
+        Event(cl_event first, cl_event last);
+
+        Event(const Event& other);
+        Event(Event&& other);
+
+        ~Event();
+
+        Event& operator=(const Event& other);
+        Event& operator=(Event&& other);
+
+        /**
+         * @brief Blocks until the operation this event belongs to completes
+         */
+        void wait() const;
+
+        /**
+         * @brief Checks whether the operation has completed without blocking
+         */
+        bool isComplete() const;
+
+        /**
+         * @brief Device time in nanoseconds when the first command was enqueued
+         *
+         * @note Profiling accessors require Device::setProfilingEnabled(true)
+         *       before the command was enqueued, otherwise they throw
+         */
+        cl_ulong getQueuedTime() const;
+
+        /**
+         * @brief Device time in nanoseconds when the first command was submitted to the device
+         */
+        cl_ulong getSubmitTime() const;
+
+        /**
+         * @brief Device time in nanoseconds when the first command started executing
+         */
+        cl_ulong getStartTime() const;
+
+        /**
+         * @brief Device time in nanoseconds when the last command finished executing
+         */
+        cl_ulong getEndTime() const;
+
+        /**
+         * @brief Execution time in nanoseconds, end of the last command minus
+         *        start of the first one
+         */
+        cl_ulong getDuration() const;
+
+        inline cl_event getCLEvent() const
+        {
+            return mCLEvent;
+        }
+
+        /**
+         * @brief Collects the OpenCL events to pass as an event wait list
+         *
+         * Default constructed (complete) events are skipped.
+         */
+        static std::vector<cl_event> getCLEvents(const std::vector<Event>& events);
+
+    private:
+        /**
+         * @param first Query the first command rather than the last one
+         */
+        cl_ulong getProfilingInfo(cl_profiling_info param, bool first) const;
+
+        cl_event mCLEvent;
+        // null unless the operation consists of several commands
+        cl_event mFirstCLEvent;
+};
+
+/**
+ * @brief Events an enqueued operation waits for before it starts
+ */
+typedef std::vector<Event> EventList;
+
+}
+
+#endif
@@ -44,16 +44,24 @@
 namespace oclcrypto
 {
 
+class BufferPool;
 class DataBuffer;
 template<typename T>
 class DataBufferReadLock;
 template<typename T>
 class DataBufferWriteLock;
 class Device;
+class Event;
 class Kernel;
+class LaunchPlanner;
 class Program;
+class ProgramBinaryCache;
 class System;
 class Task;
+typedef std::shared_ptr<Task> TaskPtr;
+class TaskScheduler;
+class TextBuffers;
+class WorkGroupTuner;
 
 class AES_Base;
 class AES_ECB_Encrypt;
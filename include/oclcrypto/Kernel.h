@@ -27,8 +27,11 @@
 #define OCLCRYPTO_KERNEL_H_
 
 #include "oclcrypto/ForwardDecls.h"
+#include "oclcrypto/Event.h"
 #include <CL/cl.h>
 
+#include <map>
+
 namespace oclcrypto
 {
 
@@ -46,10 +49,52 @@ class OCLCRYPTO_EXPORT Kernel
 
         ~Kernel();
 
+        /**
+         * @brief Pass as localWorkSize to execute with the tuned size
+         *
+         * @see suggestLocalWorkSize
+         */
+        static const size_t TunedLocalWorkSize = static_cast<size_t>(-1);
+
         Program& getProgram() const;
 
         const std::string& getName() const;
 
+        /**
+         * @brief Index of the Device command queue the kernel is enqueued on
+         */
+        size_t getQueueIndex() const;
+
+        /**
+         * @brief Selects the Device command queue to enqueue the kernel on
+         *
+         * Buffers passed as parameters should use the same queue, see
+         * DataBuffer::setQueueIndex.
+         */
+        void setQueueIndex(size_t idx);
+
+        /**
+         * @brief CL_KERNEL_WORK_GROUP_SIZE, the largest local size this kernel can run with
+         */
+        size_t getWorkGroupSize() const;
+
+        /**
+         * @brief CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, 1 before OpenCL 1.1
+         */
+        size_t getPreferredWorkGroupSizeMultiple() const;
+
+        /**
+         * @brief Local work size tuned for this kernel and program variant on its device
+         *
+         * @see Device::suggestLocalWorkSize, WorkGroupTuner
+         */
+        size_t suggestLocalWorkSize() const;
+
+        /**
+         * @note
+         * The buffer has to stay allocated until the parameter is set to
+         * something else, every enqueue of the kernel is recorded in it.
+         */
         void setParameter(size_t idx, DataBuffer& buffer);
 
         /**
@@ -76,7 +121,39 @@ class OCLCRYPTO_EXPORT Kernel
             allocateLocalParameter(idx, sizeof(T), elements);
         }
 
-        void execute(size_t globalWorkSize, size_t localWorkSize, bool blockUntilComplete = true);
+        /**
+         * @brief Enqueues the kernel on the queue of its device
+         *
+         * @param localWorkSize 0 lets the implementation choose, TunedLocalWorkSize
+         *                      uses suggestLocalWorkSize(). Sizes not dividing
+         *                      globalWorkSize are lowered until they do.
+         * @param blockUntilComplete Wait for this kernel to finish before returning
+         * @param waitList Events that have to complete before the kernel starts,
+         *                 lets multiple stages be chained without host round-trips
+         * @return Event signalling completion of the kernel
+         *
+         * @note Global sizes over LaunchPlanner::DefaultMaxLaunchSize are split
+         *       into several launches, that needs OpenCL 1.1. The returned Event
+         *       completes with the last launch and its profiling spans all of them.
+         */
+        Event execute(size_t globalWorkSize, size_t localWorkSize, bool blockUntilComplete = true,
+                      const EventList& waitList = EventList());
+
+        /**
+         * @brief Enqueues a kernel that checks its global id against the item count
+         *
+         * The global size is rounded up to whole work-groups so the local size
+         * is used as is for any item count. The count is passed to the kernel
+         * as an unsigned long parameter.
+         *
+         * @param itemCountIdx Index of the item count parameter
+         * @param itemsPerWorkItem Number of consecutive items each work-item
+         *                         processes, the kernel still gets the item count
+         * @see execute
+         */
+        Event executeBounded(size_t itemCount, size_t localWorkSize, size_t itemCountIdx,
+                             bool blockUntilComplete = true, const EventList& waitList = EventList(),
+                             size_t itemsPerWorkItem = 1);
 
         // noncopyable
         Kernel(const Kernel&) = delete;
@@ -85,8 +162,16 @@ class OCLCRYPTO_EXPORT Kernel
     private:
         void setParameterPOD(size_t idx, size_t podSize, const void* pod);
 
+        Event enqueue(size_t itemCount, size_t localWorkSize, bool boundsChecked,
+                      bool blockUntilComplete, const EventList& waitList);
+
         Program& mProgram;
         const std::string mName;
+        size_t mQueueIndex;
+        cl_ulong mItemCount;
+
+        // buffers set as parameters, they learn about every enqueue using them
+        std::map<size_t, DataBuffer*> mBufferParameters;
 
         cl_kernel mCLKernel;
 };
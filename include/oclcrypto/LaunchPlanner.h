@@ -0,0 +1,78 @@
+/*
+ * Copyright (C) 2015 Martin Preisler <martin@preisler.me>
+ *
+ * This file is part of oclcrypto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef OCLCRYPTO_LAUNCH_PLANNER_H_
+#define OCLCRYPTO_LAUNCH_PLANNER_H_
+
+#include "oclcrypto/ForwardDecls.h"
+
+namespace oclcrypto
+{
+
+/**
+ * @brief Splits a 1D range of work items into kernel launches
+ *
+ * OpenCL 1.x needs the global size to be a multiple of the local size.
+ * Kernels that check their global id against the item count can run any
+ * count at any local size, the planner rounds the global size up to whole
+ * work-groups for them. Other kernels get the local size lowered until it
+ * divides the count.
+ *
+ * Counts larger than the maximum launch size are split into several launches
+ * with global offsets, kernels don't have to care because get_global_id
+ * includes the offset.
+ */
+class OCLCRYPTO_EXPORT LaunchPlanner
+{
+    public:
+        struct Launch
+        {
+            size_t offset;
+            size_t globalWorkSize;
+            /// 0 lets the implementation choose
+            size_t localWorkSize;
+        };
+
+        typedef std::vector<Launch> LaunchList;
+
+        /**
+         * @brief Work items of a single launch, 32bit global ids stay valid
+         */
+        static const size_t DefaultMaxLaunchSize = static_cast<size_t>(1) << 31;
+
+        /**
+         * @param itemCount Number of work items that have to run
+         * @param localWorkSize Desired local size, 0 lets the implementation choose
+         * @param boundsChecked Whether the kernel ignores work items past itemCount
+         * @param maxLaunchSize Largest global size of a single launch
+         * @return Launches covering [0, itemCount) in order, empty for 0 items
+         */
+        static LaunchList plan(size_t itemCount, size_t localWorkSize, bool boundsChecked,
+                               size_t maxLaunchSize = DefaultMaxLaunchSize);
+};
+
+}
+
+#endif
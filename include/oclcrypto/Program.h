@@ -30,6 +30,8 @@
 #include <CL/cl.h>
 
 #include <map>
+#include <mutex>
+#include <string>
 
 namespace oclcrypto
 {
@@ -39,14 +41,24 @@ namespace oclcrypto
  *
  * Program is created on one particular OpenCL device annd can't be shared
  * between devices.
+ *
+ * Kernels may be created and destroyed from multiple threads at once. A
+ * Kernel itself must only be used by one thread at a time, its parameters
+ * are state shared by everyone using it.
  */
 class OCLCRYPTO_EXPORT Program
 {
     public:
         /**
          * @param source Source code of the program in ASCII
+         * @param binaryCache If not null, a matching binary from this cache is
+         *                    used instead of building from source. Programs built
+         *                    from source are stored in the cache afterwards.
+         * @param extraBuildOptions Appended to the default build options, usually
+         *                          "-D" defines specializing the program
          */
-        Program(Device& device, const std::string& source);
+        Program(Device& device, const std::string& source, ProgramBinaryCache* binaryCache = nullptr,
+                const std::string& extraBuildOptions = "");
 
         ~Program();
 
@@ -96,18 +108,45 @@ class OCLCRYPTO_EXPORT Program
 
         cl_program getCLProgram() const;
 
+        /**
+         * @brief Options passed to clBuildProgram
+         */
+        const std::string& getBuildOptions() const;
+
+        /**
+         * @brief Extra build options this program was specialized with, empty for the generic one
+         */
+        const std::string& getVariant() const;
+
+        /**
+         * @brief Returns true if the program was created from a cached binary
+         */
+        bool isFromBinaryCache() const;
+
+        /**
+         * @brief Retrieves the device specific binary of the built program
+         */
+        std::vector<unsigned char> getBinary() const;
+
         // noncopyable
         Program(const Program&) = delete;
         Program& operator=(const Program&) = delete;
 
     private:
+        bool buildFromBinary(const std::vector<unsigned char>& binary);
+        void buildFromSource();
+
         Device& mDevice;
         const std::string mSource;
+        const std::string mVariant;
+        const std::string mBuildOptions;
+        bool mFromBinaryCache;
 
         cl_program mCLProgram;
 
         typedef std::vector<Kernel*> KernelVector;
         KernelVector mKernels;
+        mutable std::mutex mKernelsMutex;
 };
 
 /**
@@ -0,0 +1,106 @@
+/*
+ * Copyright (C) 2015 Martin Preisler <martin@preisler.me>
+ *
+ * This file is part of oclcrypto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef OCLCRYPTO_PROGRAM_BINARY_CACHE_H_
+#define OCLCRYPTO_PROGRAM_BINARY_CACHE_H_
+
+#include "oclcrypto/ForwardDecls.h"
+
+#include <cstdint>
+#include <string>
+
+namespace oclcrypto
+{
+
+/**
+ * @brief Persists compiled OpenCL program binaries on disk
+ *
+ * Building programs from source can take seconds on some implementations
+ * (pocl compiles through LLVM in every process). The cache stores the
+ * CL_PROGRAM_BINARIES of built programs so that later processes can use
+ * clCreateProgramWithBinary instead.
+ *
+ * Entries are keyed by device name, device and driver version, build options
+ * and a hash of the source. The whole key is stored in the entry and compared
+ * on load, an entry that doesn't match exactly is never used.
+ */
+class OCLCRYPTO_EXPORT ProgramBinaryCache
+{
+    public:
+        /**
+         * @param directory Where the entries are stored, it is created if it
+         *                  doesn't exist (parent directories have to exist)
+         */
+        ProgramBinaryCache(const std::string& directory);
+
+        /**
+         * @brief Environment variable that enables the cache in System
+         */
+        static const char* const DirectoryEnvironmentVariable;
+
+        const std::string& getDirectory() const;
+
+        /**
+         * @brief Builds the full cache key of a program
+         */
+        static std::string makeKey(const Device& device, const std::string& buildOptions, const std::string& source);
+
+        /**
+         * @brief Loads the binary stored under given key
+         *
+         * @return false if there is no entry, the entry belongs to a different
+         *         key or it is damaged
+         */
+        bool load(const std::string& key, std::vector<unsigned char>& binary) const;
+
+        /**
+         * @brief Stores binary under given key, replacing previous entry atomically
+         *
+         * The entry is written to a temporary file first and then renamed,
+         * concurrent processes never see a partially written entry.
+         *
+         * @return false if the entry couldn't be written, the cache is best effort
+         */
+        bool store(const std::string& key, const std::vector<unsigned char>& binary) const;
+
+        /**
+         * @brief Removes the entry stored under given key
+         */
+        bool remove(const std::string& key) const;
+
+        /**
+         * @brief 64bit FNV-1a hash of given data
+         */
+        static uint64_t hash(const std::string& data);
+
+    private:
+        std::string getEntryPath(const std::string& key) const;
+
+        const std::string mDirectory;
+};
+
+}
+
+#endif
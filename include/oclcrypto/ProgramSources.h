@@ -28,6 +28,10 @@
 
 #include "oclcrypto/ForwardDecls.h"
 
+#include <map>
+#include <string>
+#include <vector>
+
 namespace oclcrypto
 {
 
@@ -42,11 +46,30 @@ class OCLCRYPTO_EXPORT ProgramSources
             PROGRAM_COUNT
         };
 
+        /**
+         * @brief Preprocessor defines a program is specialized with, name to value
+         *
+         * Ordered so that equal sets always produce the same build options.
+         */
+        typedef std::map<std::string, std::string> Defines;
+
         inline static const char* getProgramSource(ProgramType type)
         {
             return msSources[type];
         }
 
+        /**
+         * @brief Turns given defines into "-D NAME=VALUE" build options
+         */
+        static std::string getBuildOptions(const Defines& defines);
+
+        /**
+         * @brief Returns the defines of all variants of given program the ciphers use
+         *
+         * These are the variants built by System::warmUp.
+         */
+        static std::vector<Defines> getVariants(ProgramType type);
+
     private:
         static const char* msSources[];
 };
@@ -31,7 +31,12 @@
 
 // TODO: Hide CL dependency
 #include <CL/cl.h>
+#include <functional>
+#include <future>
 #include <map>
+#include <memory>
+#include <mutex>
+#include <string>
 
 namespace oclcrypto
 {
@@ -42,11 +47,20 @@ namespace oclcrypto
  * Since it's very tricky to figure out the exact load of an OpenCL device,
  * we make these bold assumptions:
  *  - The devices are only used by oclcrypto
- *  - Each device has a certain "capacity" (we use lookup tables)
+ *  - Each device has a certain "capacity", see Device::getCapacity
  *
  * OpenCL itself will queue the jobs and split them up if the driver deems
  * it reasonable. If he have multiple GPUs or other OpenCL devices we still
- * want to queue the jobs in the best possible queue.
+ * want to queue the jobs in the best possible queue. Tasks passed to submit
+ * are dispatched to the least loaded device by the TaskScheduler.
+ *
+ * @par Thread safety
+ * One System, its devices and programs can be shared by any number of threads.
+ * Each thread uses its own cipher objects, those are not synchronized. Only
+ * creating kernels and (re)allocating buffers takes a lock, executing a cipher
+ * with unchanged key and text sizes doesn't lock anything on the host. All
+ * OpenCL calls we make are thread-safe except clSetKernelArg, which is only
+ * called on kernels owned by one cipher.
  */
 class OCLCRYPTO_EXPORT System
 {
@@ -55,11 +69,15 @@ class OCLCRYPTO_EXPORT System
          * @brief Queries available OpenCL devices and initializes accordingly
          *
          * @param useCPUs Should CPU OpenCL devices also be used by oclcrypto
+         * @param prebuildPrograms Start building all programs for all devices
+         *                         on background threads right away, see warmUp()
          */
-        System(bool useCPUs = false);
+        System(bool useCPUs = false, bool prebuildPrograms = false);
 
         /**
          * @brief Frees resources allocated as part of initialization
+         *
+         * @note Waits for programs that are still being built in the background
          */
         ~System();
 
@@ -71,33 +89,131 @@ class OCLCRYPTO_EXPORT System
         /**
          * @brief Allows you to iterate over available devices
          *
+         * Devices are ordered by their capacity, the highest first.
+         *
          * @param idx Index, at least 0 but lower than what getDeviceCount() returns
          * @note Consider using the higher level API instead of this function.
-         * @note The order of devices is undefined and may change!
+         * @note The order may change after calibrateDevices()!
          */
         Device& getDevice(size_t idx);
 
         /**
-         * @brief Gets the best available device, prefers GPU over CPU
+         * @brief Gets the device with the highest capacity
+         *
+         * GPUs usually win over CPUs thanks to their Device::getCapacity estimate.
+         * If a preferred device is set it is returned instead, see setPreferredDevice.
          *
-         * @todo This just returns the first found device right now!
+         * @throws std::invalid_argument if the preferred device doesn't match any device
          */
         Device& getBestDevice();
 
+        /**
+         * @brief Environment variable with the initial preferred device
+         */
+        static const char* const DeviceEnvironmentVariable;
+
+        /**
+         * @brief Overrides the choice of getBestDevice
+         *
+         * @param selector Either an index into the devices as returned by getDevice,
+         *                 or a part of the device name, e.g. "GeForce". The first
+         *                 device by capacity containing it is picked. Empty string
+         *                 restores the choice by capacity.
+         *
+         * Initialized from the OCLCRYPTO_DEVICE environment variable.
+         */
+        void setPreferredDevice(const std::string& selector);
+
+        const std::string& getPreferredDevice() const;
+
+        /**
+         * @brief Replaces the estimated capacities with measured throughput
+         *
+         * Encrypts given amount of data with AES-128 ECB on every device and
+         * sets the capacity to the throughput in bytes per microsecond. Devices
+         * are then reordered. The programs get built as a side effect.
+         *
+         * @note Takes a while, has to be called before the System is shared
+         *       between threads
+         */
+        void calibrateDevices(size_t bytes = 4 * 1024 * 1024);
+
         /**
          * @brief Retrieves given program type for given device from cache or create it
          *
          * @param device Which device will we run our desired program on
          * @param type Type of the program, see ProgramSources
+         * @param defines Preprocessor defines to specialize the program with,
+         *                each distinct set is a separately built and cached program
          *
          * @par
          * The point of this method is to avoid compiling the same program sources
          * over and over. Instead we compile them once and use multiple times.
          *
-         * We still have to create a kernel per execution because we always want
-         * different arguments.
+         * Ciphers create their kernel from the program once and keep reusing it,
+         * only the changed arguments are set again, see AES_Base::prepareKernel.
+         *
+         * If the program is being built in the background this blocks until the
+         * build finishes. Build failures are rethrown to every caller waiting
+         * for that build, they aren't cached, the next call builds again.
+         *
+         * BLOCKS_PER_ITEM is defined as Device::getBlocksPerWorkItem unless
+         * given in defines.
+         */
+        Program& getProgramFromCache(Device& device, ProgramSources::ProgramType type,
+                                     const ProgramSources::Defines& defines = ProgramSources::Defines());
+
+        /**
+         * @brief Builds all program types for all devices and blocks until they are ready
+         *
+         * All variants returned by ProgramSources::getVariants are built. Programs
+         * that haven't been requested yet are built concurrently, one
+         * thread per device and program type. Programs already being built by
+         * the prebuild started at construction are waited for.
+         *
+         * @note Throws the first build failure encountered, the remaining
+         *       programs are still waited for
+         */
+        void warmUp();
+
+        /**
+         * @brief Enables the on-disk cache of program binaries
+         *
+         * Programs created by getProgramFromCache are loaded from the cache when
+         * possible, that cuts down the startup time considerably. The cache is
+         * enabled at construction if the OCLCRYPTO_PROGRAM_CACHE_DIR environment
+         * variable is set.
+         *
+         * Local work sizes found by WorkGroupTuner are stored in the same cache,
+         * they are loaded for all devices whenever the directory is set.
+         *
+         * @param directory Where to store the binaries, empty string disables the cache
+         * @note Only affects programs that haven't been created yet
+         */
+        void setProgramBinaryCacheDirectory(const std::string& directory);
+
+        /**
+         * @brief Returns the program binary cache, nullptr if it's disabled
+         */
+        ProgramBinaryCache* getProgramBinaryCache() const;
+
+        /**
+         * @brief Queues given task to run on the least loaded device
+         *
+         * The TaskScheduler is started on the first submit, see getTaskScheduler.
+         *
+         * @return The task itself, it's the handle to wait on and read results from
+         * @throws std::invalid_argument if the task was submitted already or
+         *         there are no devices
          */
-        Program& getProgramFromCache(Device& device, ProgramSources::ProgramType type);
+        TaskPtr submit(const TaskPtr& task);
+
+        /**
+         * @brief Returns the scheduler running submitted tasks, starts it if needed
+         *
+         * @note Destroying the System runs all queued tasks first
+         */
+        TaskScheduler& getTaskScheduler();
 
         //DeviceAllocationPtr allocateDevice(unsigned int workload = 1);
 
@@ -114,13 +230,38 @@ class OCLCRYPTO_EXPORT System
     private:
         void initializePlatform(cl_platform_id platform, bool useCPUs);
 
-        typedef std::multimap<int, Device*> DeviceMap;
+        /**
+         * @brief Starts background builds of all programs that aren't cached yet
+         */
+        void prebuildPrograms();
+
+        /**
+         * @brief Loads local work sizes tuned by WorkGroupTuner from the binary cache
+         */
+        void loadTunedLocalWorkSizes();
+
+        // ordered by capacity, best device first
+        typedef std::multimap<unsigned int, Device*, std::greater<unsigned int> > DeviceMap;
         DeviceMap mDevices;
 
-        typedef std::map<ProgramSources::ProgramType, Program*> ProgramCacheMap;
+        std::string mPreferredDevice;
+
+        // programs are built asynchronously, the future is ready once the
+        // build finishes and holds the exception if it failed
+        typedef std::shared_future<Program*> ProgramFuture;
+        // keyed by the program type and the build options made from its defines
+        typedef std::pair<ProgramSources::ProgramType, std::string> ProgramCacheKey;
+        typedef std::map<ProgramCacheKey, ProgramFuture> ProgramCacheMap;
         typedef std::map<Device*, ProgramCacheMap> DeviceProgramCacheMap;
 
         DeviceProgramCacheMap mDeviceProgramCacheMap;
+        std::mutex mProgramCacheMutex;
+
+        std::shared_ptr<ProgramBinaryCache> mProgramBinaryCache;
+
+        // created lazily, most users never submit tasks and don't need the threads
+        std::unique_ptr<TaskScheduler> mTaskScheduler;
+        std::mutex mTaskSchedulerMutex;
 };
 
 }
@@ -28,18 +28,32 @@
 
 #include "oclcrypto/ForwardDecls.h"
 
-#include <memory>
+#include <atomic>
+#include <condition_variable>
+#include <exception>
+#include <functional>
+#include <mutex>
+#include <string>
 
 namespace oclcrypto
 {
 
 enum TaskAlgorithm
 {
-    TA_PASSTHROUGH = 1
+    /// output is a copy of the input, made by a round-trip through the device
+    TA_PASSTHROUGH = 1,
+    TA_AES_ECB_ENCRYPT = 2,
+    TA_AES_ECB_DECRYPT = 3,
+    /// secret is the key, iv the 16 byte initial counter
+    TA_AES_CTR_ENCRYPT = 4,
+    /// secret is the key, iv the 12 byte initial vector
+    TA_AES_GCM_ENCRYPT = 5,
+    TA_BLOWFISH_ECB_ENCRYPT = 6
 };
 
 enum TaskState
 {
+    /// created or waiting in the queue of the TaskScheduler
     TS_SPECIFIED = 1,
     TS_RUNNING = 2,
     TS_ERROR = 3,
@@ -47,27 +61,91 @@ enum TaskState
 };
 
 /**
- * @brief
+ * @brief One unit of work for the TaskScheduler, see System::submit
+ *
+ * Input and secrets are host memory, the task doesn't care which device
+ * ends up running it. The scheduler picks the device once the task is
+ * dequeued.
+ *
+ * The state only ever moves forward, TS_SPECIFIED -> TS_RUNNING and then
+ * either TS_FINISHED or TS_ERROR. The completion callback is invoked on
+ * a worker thread of the scheduler after the final state is set, wait()
+ * returns once the callback is done.
  */
 class OCLCRYPTO_EXPORT Task
 {
     public:
-        inline Task(Algorithm algorithm, ConstBufferPtr input, ConstBufferPtr secret, BufferPtr output):
-            algorithm(algorithm),
-            state(TS_SPECIFIED),
+        typedef std::function<void(Task&)> Callback;
 
-            input(input),
-            secret(secret),
-            output(output)
-        {}
+        Task(TaskAlgorithm algorithm, const std::vector<unsigned char>& input,
+             const std::vector<unsigned char>& secret = std::vector<unsigned char>(),
+             const std::vector<unsigned char>& iv = std::vector<unsigned char>());
 
         const TaskAlgorithm algorithm;
-        std::atomic<TaskState> state;
 
-        const ConstBufferPtr input;
-        const ConstBufferPtr secret;
-        /// @note This can only be valid if task.state equals TS_FINISHED
-        const BufferPtr output;
+        const std::vector<unsigned char> input;
+        const std::vector<unsigned char> secret;
+        const std::vector<unsigned char> iv;
+
+        inline TaskState getState() const
+        {
+            return mState;
+        }
+
+        /**
+         * @brief Sets the function called once the task finishes or fails
+         *
+         * @note Has to be set before the task is submitted. Exceptions thrown
+         *       by the callback are swallowed.
+         */
+        void setCallback(const Callback& callback);
+
+        /**
+         * @brief Blocks until the task finished or failed and its callback returned
+         */
+        void wait() const;
+
+        /**
+         * @brief Result of the task
+         *
+         * @throws std::runtime_error if the task hasn't finished yet
+         * @note Rethrows the failure if the state is TS_ERROR
+         */
+        const std::vector<unsigned char>& getOutput() const;
+
+        /**
+         * @brief The failure of the task, null unless the state is TS_ERROR
+         */
+        std::exception_ptr getError() const;
+
+        /**
+         * @brief Device the task was dispatched to, nullptr while it's queued
+         */
+        Device* getDevice() const;
+
+        // noncopyable
+        Task(const Task&) = delete;
+        Task& operator=(const Task&) = delete;
+
+    private:
+        friend class TaskScheduler;
+
+        void setRunning(Device& device);
+        void setFinished(std::vector<unsigned char>& output);
+        void setError(std::exception_ptr error);
+        void complete(TaskState state);
+
+        std::atomic<bool> mSubmitted;
+        std::atomic<TaskState> mState;
+        std::atomic<Device*> mDevice;
+
+        Callback mCallback;
+        std::vector<unsigned char> mOutput;
+        std::exception_ptr mError;
+
+        bool mDone;
+        mutable std::mutex mMutex;
+        mutable std::condition_variable mCompleted;
 };
 
 }
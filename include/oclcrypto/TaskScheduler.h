@@ -0,0 +1,124 @@
+/*
+ * Copyright (C) 2015 Martin Preisler <martin@preisler.me>
+ *
+ * This file is part of oclcrypto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef OCLCRYPTO_TASK_SCHEDULER_H_
+#define OCLCRYPTO_TASK_SCHEDULER_H_
+
+#include "oclcrypto/ForwardDecls.h"
+
+#include <condition_variable>
+#include <deque>
+#include <map>
+#include <mutex>
+#include <thread>
+
+namespace oclcrypto
+{
+
+/**
+ * @brief Runs submitted Tasks on all devices of a System
+ *
+ * Tasks wait in a single FIFO queue. Worker threads take them out and
+ * dispatch each to the least loaded device at that moment. The load of
+ * a device is the number of bytes of its running tasks divided by its
+ * capacity (see Device::getCapacity), so faster devices get proportionally
+ * more work.
+ *
+ * Every worker creates its own cipher objects, the workers only share the
+ * System which is thread-safe.
+ */
+class OCLCRYPTO_EXPORT TaskScheduler
+{
+    public:
+        /**
+         * @param workerCount Number of worker threads, 0 means two per device
+         *                    so that transfers of one task overlap with the
+         *                    kernel of another
+         */
+        TaskScheduler(System& system, size_t workerCount = 0);
+
+        /**
+         * @brief Runs all queued tasks to completion and stops the workers
+         */
+        ~TaskScheduler();
+
+        /**
+         * @brief Queues given task, it has to be in the TS_SPECIFIED state
+         *
+         * @throws std::invalid_argument if the task was submitted already
+         */
+        void submit(const TaskPtr& task);
+
+        /**
+         * @brief Blocks until there are no queued or running tasks
+         */
+        void waitIdle();
+
+        size_t getWorkerCount() const;
+
+        /**
+         * @brief Number of tasks waiting for a worker
+         */
+        size_t getQueuedCount() const;
+
+        /**
+         * @brief Bytes of the tasks currently running on given device
+         */
+        size_t getDeviceLoad(const Device& device) const;
+
+        // noncopyable
+        TaskScheduler(const TaskScheduler&) = delete;
+        TaskScheduler& operator=(const TaskScheduler&) = delete;
+
+    private:
+        void workerLoop();
+
+        /**
+         * @brief Picks the least loaded device and adds given bytes to its load
+         */
+        Device& acquireDevice(size_t bytes);
+        void releaseDevice(Device& device, size_t bytes);
+
+        void run(Device& device, const Task& task, std::vector<unsigned char>& output);
+
+        System& mSystem;
+
+        typedef std::map<Device*, size_t> DeviceLoadMap;
+        DeviceLoadMap mDeviceLoads;
+
+        std::deque<TaskPtr> mQueue;
+        size_t mRunningCount;
+        bool mStopping;
+
+        mutable std::mutex mMutex;
+        std::condition_variable mQueueChanged;
+        std::condition_variable mIdle;
+
+        std::vector<std::thread> mWorkers;
+};
+
+}
+
+#endif
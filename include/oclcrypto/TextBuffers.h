@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2015 Martin Preisler <martin@preisler.me>
+ *
+ * This file is part of oclcrypto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef OCLCRYPTO_TEXT_BUFFERS_H_
+#define OCLCRYPTO_TEXT_BUFFERS_H_
+
+#include "oclcrypto/ForwardDecls.h"
+
+#include <string>
+
+namespace oclcrypto
+{
+
+/**
+ * @brief Input and output text buffers of one cipher
+ *
+ * The input is copied, wraps host memory or is a view of another buffer,
+ * the output is allocated to match it. In in-place mode both are one
+ * DataBuffer::ReadWrite buffer the kernel overwrites.
+ *
+ * Checks common to all ciphers are done here, ciphers add their own
+ * before passing the text on.
+ */
+class OCLCRYPTO_EXPORT TextBuffers
+{
+    public:
+        /**
+         * @param device Device all buffers are allocated on
+         * @param blockSize Size of the cipher block, text sizes have to be its multiple
+         * @param cipherName Name of the cipher used in error messages
+         * @param decryption If true the input is ciphertext and the output plaintext
+         */
+        TextBuffers(Device& device, size_t blockSize, const std::string& cipherName, bool decryption);
+        ~TextBuffers();
+
+        /**
+         * @brief Copies given input into a device buffer
+         */
+        void setInput(const unsigned char* input, size_t size, size_t queueIndex);
+
+        /**
+         * @brief Wraps given input memory if possible, copies it otherwise
+         *
+         * @return true if the memory is used directly, false if it was copied
+         */
+        bool wrapInput(const unsigned char* input, size_t size, size_t queueIndex);
+
+        /**
+         * @brief Uses a view of [offset, offset + size) of given buffer as input
+         */
+        void setInputView(DataBuffer& buffer, size_t offset, size_t size, size_t queueIndex);
+
+        /**
+         * @brief Takes effect with the next call setting the input
+         */
+        void setInPlace(bool inPlace);
+
+        inline bool isInPlace() const
+        {
+            return mInPlace;
+        }
+
+        /**
+         * @brief Moves both buffers to given command queue
+         */
+        void setQueueIndex(size_t idx);
+
+        inline DataBuffer* getInput()
+        {
+            return mInput;
+        }
+
+        inline DataBuffer* getOutput()
+        {
+            return mOutput;
+        }
+
+        // noncopyable
+        TextBuffers(const TextBuffers&) = delete;
+        TextBuffers& operator=(const TextBuffers&) = delete;
+
+    private:
+        void checkSize(size_t size) const;
+        void deallocateInput();
+        void allocateOutput(size_t size, size_t queueIndex);
+
+        Device& mDevice;
+        const size_t mBlockSize;
+        const std::string mCipherName;
+        const std::string mInputName;
+        const std::string mOutputName;
+
+        DataBuffer* mInput;
+        DataBuffer* mOutput;
+
+        bool mInPlace;
+};
+
+}
+
+#endif
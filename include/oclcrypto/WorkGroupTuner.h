@@ -0,0 +1,102 @@
+/*
+ * Copyright (C) 2015 Martin Preisler <martin@preisler.me>
+ *
+ * This file is part of oclcrypto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef OCLCRYPTO_WORK_GROUP_TUNER_H_
+#define OCLCRYPTO_WORK_GROUP_TUNER_H_
+
+#include "oclcrypto/ForwardDecls.h"
+#include "oclcrypto/ProgramSources.h"
+
+#include <string>
+
+namespace oclcrypto
+{
+
+/**
+ * @brief Finds the fastest local work size of every kernel on every device
+ *
+ * For each kernel and program variant the tuner queries
+ * CL_KERNEL_WORK_GROUP_SIZE and CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE,
+ * runs the cipher on a calibration workload with every candidate size and
+ * records the fastest one in the Device, see Device::suggestLocalWorkSize.
+ *
+ * Results are persisted in the ProgramBinaryCache of the System when it's
+ * enabled, System loads them for every device at construction.
+ */
+class OCLCRYPTO_EXPORT WorkGroupTuner
+{
+    public:
+        WorkGroupTuner(System& system);
+
+        /**
+         * @brief Tunes all kernels on all devices of the System
+         *
+         * @param bytes Size of the calibration workload, rounded up to 16 KiB
+         * @note Takes a while, has to be called before the System is shared
+         *       between threads
+         */
+        void tune(size_t bytes = 1024 * 1024);
+
+        /**
+         * @brief Tunes all kernels on given device
+         */
+        void tune(Device& device, size_t bytes = 1024 * 1024);
+
+        /**
+         * @brief Candidate local sizes for a kernel with given limits
+         *
+         * 0 (implementation's choice) followed by the power of two multiples
+         * of the preferred multiple that don't exceed workGroupSize.
+         */
+        static std::vector<size_t> getCandidates(size_t workGroupSize, size_t preferredMultiple);
+
+        /**
+         * @brief Loads previously stored tuned sizes of given device
+         *
+         * @return false if there are none or they are damaged
+         */
+        static bool load(Device& device, const ProgramBinaryCache& cache);
+
+        /**
+         * @brief Stores tuned sizes of given device
+         *
+         * @return false if the entry couldn't be written
+         */
+        static bool store(const Device& device, const ProgramBinaryCache& cache);
+
+    private:
+        template<typename Cipher>
+        void tuneCipher(Device& device, Cipher& cipher, const std::string& kernelName,
+                        ProgramSources::ProgramType type, const ProgramSources::Defines& defines,
+                        size_t workItemCount);
+
+        static std::string makeCacheKey(const Device& device);
+
+        System& mSystem;
+};
+
+}
+
+#endif
@@ -25,6 +25,17 @@
 
 // See http://csrc.nist.gov/publications/fips/fips197/fips-197.pdf
 
+// Programs specialized for one key size are built with -D AES_ROUNDS=n where n
+// is the number of round keys, the same value the rounds argument carries.
+// The round loops then have a constant trip count and get fully unrolled.
+#ifdef AES_ROUNDS
+#   define AES_ROUND_KEY_COUNT(rounds) AES_ROUNDS
+#   define AES_UNROLL _Pragma("unroll")
+#else
+#   define AES_ROUND_KEY_COUNT(rounds) (rounds)
+#   define AES_UNROLL
+#endif
+
 inline uchar16 AES_AddRoundKey(uchar16 state, uchar16 key)
 {
     return state ^ key;
@@ -274,14 +285,15 @@ inline uchar16 AES_MixColumns(uchar16 state)
     );
 }
 
+// The inverse matrix factors into MixColumns times {05, 00, 04, 00} rotated,
+// that takes 12 lookups per column rather than 16 (see "The Design of
+// Rijndael", 4.1.3). {04} * x is {02} * ({02} * x).
 inline uchar4 AES_InverseMixColumn(uchar4 state)
 {
-    return (uchar4)(
-        AES_Galois14[state.s0] ^ AES_Galois11[state.s1] ^ AES_Galois13[state.s2] ^ AES_Galois9[state.s3],
-        AES_Galois9[state.s0]  ^ AES_Galois14[state.s1] ^ AES_Galois11[state.s2] ^ AES_Galois13[state.s3],
-        AES_Galois13[state.s0] ^ AES_Galois9[state.s1]  ^ AES_Galois14[state.s2] ^ AES_Galois11[state.s3],
-        AES_Galois11[state.s0] ^ AES_Galois13[state.s1] ^ AES_Galois9[state.s2]  ^ AES_Galois14[state.s3]
-    );
+    const uchar u = AES_Galois2[AES_Galois2[state.s0 ^ state.s2]];
+    const uchar v = AES_Galois2[AES_Galois2[state.s1 ^ state.s3]];
+
+    return AES_MixColumn(state ^ (uchar4)(u, v, u, v));
 }
 
 inline uchar16 AES_InverseMixColumns(uchar16 state)
@@ -293,6 +305,139 @@ inline uchar16 AES_InverseMixColumns(uchar16 state)
         AES_InverseMixColumn(state.sCDEF)
     );
 }
+
+// Columns of the state packed into 32bit words with row 0 in the lowest byte,
+// that's as_uint4 of the state on little endian devices.
+
+inline uint AES_PackColumn(uchar r0, uchar r1, uchar r2, uchar r3)
+{
+    return (uint)r0 | ((uint)r1 << 8) | ((uint)r2 << 16) | ((uint)r3 << 24);
+}
+
+inline uint4 AES_ToColumns(uchar16 state)
+{
+#ifdef __ENDIAN_LITTLE__
+    return as_uint4(state);
+#else
+    return (uint4)(
+        AES_PackColumn(state.s0, state.s1, state.s2, state.s3),
+        AES_PackColumn(state.s4, state.s5, state.s6, state.s7),
+        AES_PackColumn(state.s8, state.s9, state.sA, state.sB),
+        AES_PackColumn(state.sC, state.sD, state.sE, state.sF)
+    );
+#endif
+}
+
+inline uchar16 AES_FromColumns(uint4 columns)
+{
+#ifdef __ENDIAN_LITTLE__
+    return as_uchar16(columns);
+#else
+    return (uchar16)(
+        (uchar)columns.x, (uchar)(columns.x >> 8), (uchar)(columns.x >> 16), (uchar)(columns.x >> 24),
+        (uchar)columns.y, (uchar)(columns.y >> 8), (uchar)(columns.y >> 16), (uchar)(columns.y >> 24),
+        (uchar)columns.z, (uchar)(columns.z >> 8), (uchar)(columns.z >> 16), (uchar)(columns.z >> 24),
+        (uchar)columns.w, (uchar)(columns.w >> 8), (uchar)(columns.w >> 16), (uchar)(columns.w >> 24)
+    );
+#endif
+}
+
+#ifdef AES_T_TABLES
+
+// T-tables merge SubBytes and MixColumns (or their inverses) of one byte into
+// a single 32bit lookup, a round is then 16 lookups and XORs on whole columns.
+//
+// The tables take 4 KiB, they are computed from the constant tables above
+// into local memory by each work-group. Te1 to Te3 are Te0 rotated by one,
+// two and three bytes, same for Td.
+
+// has to be called by all work-items of the work-group, followed by a barrier
+inline void AES_FillTTables(__local uint* tables)
+{
+    for (size_t i = get_local_id(0); i < 256; i += get_local_size(0))
+    {
+        const uchar s = AES_Sbox[i];
+        // first column of M times s, see MixColumns
+        const uint te0 = AES_PackColumn(AES_Galois2[s], s, s, AES_Galois3[s]);
+
+        tables[i] = te0;
+        tables[256 + i] = rotate(te0, 8u);
+        tables[512 + i] = rotate(te0, 16u);
+        tables[768 + i] = rotate(te0, 24u);
+    }
+}
+
+// has to be called by all work-items of the work-group, followed by a barrier
+inline void AES_FillInverseTTables(__local uint* tables)
+{
+    for (size_t i = get_local_id(0); i < 256; i += get_local_size(0))
+    {
+        const uchar s = AES_InverseSbox[i];
+        // first column of the inverse of M times s, see InverseMixColumns
+        const uint td0 = AES_PackColumn(AES_Galois14[s], AES_Galois9[s], AES_Galois13[s], AES_Galois11[s]);
+
+        tables[i] = td0;
+        tables[256 + i] = rotate(td0, 8u);
+        tables[512 + i] = rotate(td0, 16u);
+        tables[768 + i] = rotate(td0, 24u);
+    }
+}
+
+// SubBytes, ShiftRows, MixColumns and AddRoundKey, row r of output column j
+// comes from column j + r
+inline uint4 AES_TTableRound(uint4 c, __local const uint* te, uint4 key)
+{
+    return (uint4)(
+        te[c.x & 0xff] ^ te[256 + ((c.y >> 8) & 0xff)] ^ te[512 + ((c.z >> 16) & 0xff)] ^ te[768 + (c.w >> 24)] ^ key.x,
+        te[c.y & 0xff] ^ te[256 + ((c.z >> 8) & 0xff)] ^ te[512 + ((c.w >> 16) & 0xff)] ^ te[768 + (c.x >> 24)] ^ key.y,
+        te[c.z & 0xff] ^ te[256 + ((c.w >> 8) & 0xff)] ^ te[512 + ((c.x >> 16) & 0xff)] ^ te[768 + (c.y >> 24)] ^ key.z,
+        te[c.w & 0xff] ^ te[256 + ((c.x >> 8) & 0xff)] ^ te[512 + ((c.y >> 16) & 0xff)] ^ te[768 + (c.z >> 24)] ^ key.w
+    );
+}
+
+// InverseShiftRows, InverseSubBytes, InverseMixColumns and AddRoundKey with
+// a key that went through InverseMixColumns, row r of output column j comes
+// from column j - r
+inline uint4 AES_InverseTTableRound(uint4 c, __local const uint* td, uint4 key)
+{
+    return (uint4)(
+        td[c.x & 0xff] ^ td[256 + ((c.w >> 8) & 0xff)] ^ td[512 + ((c.z >> 16) & 0xff)] ^ td[768 + (c.y >> 24)] ^ key.x,
+        td[c.y & 0xff] ^ td[256 + ((c.x >> 8) & 0xff)] ^ td[512 + ((c.w >> 16) & 0xff)] ^ td[768 + (c.z >> 24)] ^ key.y,
+        td[c.z & 0xff] ^ td[256 + ((c.y >> 8) & 0xff)] ^ td[512 + ((c.x >> 16) & 0xff)] ^ td[768 + (c.w >> 24)] ^ key.z,
+        td[c.w & 0xff] ^ td[256 + ((c.z >> 8) & 0xff)] ^ td[512 + ((c.y >> 16) & 0xff)] ^ td[768 + (c.x >> 24)] ^ key.w
+    );
+}
+
+// all rounds but the first AddRoundKey and the last round
+inline uchar16 AES_TTableRounds(uchar16 state, __local const uchar16* keys, const unsigned int roundKeys,
+                                __local const uint* te)
+{
+    uint4 c = AES_ToColumns(state);
+
+    AES_UNROLL
+    for (int i = 1; i < roundKeys - 1; ++i)
+        c = AES_TTableRound(c, te, AES_ToColumns(keys[i]));
+
+    return AES_FromColumns(c);
+}
+
+// The equivalent inverse cipher (FIPS-197 5.3.5) with the decryption key
+// schedule, see AES_Base::invertKeyRounds. Ends before the last
+// InverseShiftRows, InverseSubBytes and AddRoundKey.
+inline uchar16 AES_InverseTTableRounds(uchar16 state, __local const uchar16* keys, const unsigned int roundKeys,
+                                       __local const uint* td)
+{
+    uint4 c = AES_ToColumns(state);
+
+    AES_UNROLL
+    for (int i = roundKeys - 2; i >= 1; --i)
+        c = AES_InverseTTableRound(c, td, AES_ToColumns(keys[i]));
+
+    return AES_FromColumns(c);
+}
+
+#endif
+
 /*
 inline void AES_DebugPrintBlock(uchar16 block)
 {
@@ -304,134 +449,276 @@ inline void AES_DebugPrintBlock(uchar16 block)
     printf("\n");
 }*/
 
+// Each work-item handles BLOCKS_PER_ITEM blocks, the host picks the number for
+// each device, see Device::getBlocksPerWorkItem. A work-group covers one
+// contiguous range of blocks, its work-items take every local size-th block
+// of it so that neighbouring work-items always access neighbouring blocks.
+#ifndef BLOCKS_PER_ITEM
+#   define BLOCKS_PER_ITEM 1
+#endif
+
+// index of block b of this work-item
+inline size_t AES_BlockIndex(int b)
+{
+    const size_t groupStart = (get_global_id(0) - get_local_id(0)) * BLOCKS_PER_ITEM;
+    return groupStart + b * get_local_size(0) + get_local_id(0);
+}
+
+#ifdef AES_T_TABLES
+#   define AES_TABLES_PARAM , __local const uint* tables
+#   define AES_TABLES_ARG , localTables
+#else
+#   define AES_TABLES_PARAM
+#   define AES_TABLES_ARG
+#endif
+
+inline uchar16 AES_Encrypt(uchar16 state, __local const uchar16* keys, const unsigned int roundKeys
+                           AES_TABLES_PARAM)
+{
+    state = AES_AddRoundKey(state, keys[0]);
+
+#ifdef AES_T_TABLES
+    state = AES_TTableRounds(state, keys, roundKeys, tables);
+#else
+    AES_UNROLL
+    for (int i = 1; i < roundKeys - 1; ++i)
+    {
+        state = AES_SubBytes(state);
+        state = AES_ShiftRows(state);
+        state = AES_MixColumns(state);
+        state = AES_AddRoundKey(state, keys[i]);
+    }
+#endif
+
+    state = AES_SubBytes(state);
+    state = AES_ShiftRows(state);
+
+    return AES_AddRoundKey(state, keys[roundKeys - 1]);
+}
+
+// The equivalent inverse cipher, keys is the decryption key schedule with
+// InverseMixColumns already applied on the host, see AES_Base::invertKeyRounds.
+// The rounds mirror AES_Encrypt, nothing has to be done to the keys here.
+inline uchar16 AES_Decrypt(uchar16 state, __local const uchar16* keys, const unsigned int roundKeys
+                           AES_TABLES_PARAM)
+{
+    state = AES_AddRoundKey(state, keys[roundKeys - 1]);
+
+#ifdef AES_T_TABLES
+    state = AES_InverseTTableRounds(state, keys, roundKeys, tables);
+#else
+    AES_UNROLL
+    for (int i = roundKeys - 2; i >= 1; --i)
+    {
+        state = AES_InverseSubBytes(state);
+        state = AES_InverseShiftRows(state);
+        state = AES_InverseMixColumns(state);
+        state = AES_AddRoundKey(state, keys[i]);
+    }
+#endif
+
+    state = AES_InverseSubBytes(state);
+    state = AES_InverseShiftRows(state);
+
+    return AES_AddRoundKey(state, keys[0]);
+}
+
+#ifndef AES_BITSLICED
+// plainText and cipherText may be the same buffer in in-place mode,
+// they must not be declared restrict
 __kernel void AES_ECB_Encrypt(
-    __global __read_only uchar16* restrict plainText,
+    __global __read_only uchar16* plainText,
     __global __read_only uchar16* restrict expandedKey,
-    __global __write_only uchar16* restrict cipherText,
-    const unsigned int rounds)
+    __global __write_only uchar16* cipherText,
+    const unsigned int rounds,
+    const unsigned long blockCount)
 {
+    const unsigned int roundKeys = AES_ROUND_KEY_COUNT(rounds);
     __local uchar16 localExpandedKey[15];
+#ifdef AES_T_TABLES
+    __local uint localTables[4 * 256];
+#endif
 
     event_t cacheEvent;
     cacheEvent = async_work_group_copy(
         localExpandedKey,
         expandedKey,
-        rounds,
+        roundKeys,
         cacheEvent
     );
 
-    const int global_id = get_global_id(0);
-    uchar16 state = plainText[global_id];
+#ifdef AES_T_TABLES
+    AES_FillTTables(localTables);
+#endif
+
     wait_group_events(1, &cacheEvent);
+#ifdef AES_T_TABLES
+    // tables are filled by the whole work-group
+    barrier(CLK_LOCAL_MEM_FENCE);
+#endif
 
-    state = AES_AddRoundKey(state, localExpandedKey[0]);
+    // the global size is rounded up to whole work-groups, see LaunchPlanner
+    if (AES_BlockIndex(0) >= blockCount)
+        return;
 
-    for (int i = 1; i < rounds - 1; ++i)
+    // all loads are issued before the first block is encrypted
+    uchar16 states[BLOCKS_PER_ITEM];
+    for (int b = 0; b < BLOCKS_PER_ITEM; ++b)
     {
-        state = AES_SubBytes(state);
-        state = AES_ShiftRows(state);
-        state = AES_MixColumns(state);
-        state = AES_AddRoundKey(state, localExpandedKey[i]);
+        const size_t idx = AES_BlockIndex(b);
+        states[b] = idx < blockCount ? plainText[idx] : (uchar16)(0);
     }
 
-    state = AES_SubBytes(state);
-    state = AES_ShiftRows(state);
+    for (int b = 0; b < BLOCKS_PER_ITEM; ++b)
+        states[b] = AES_Encrypt(states[b], localExpandedKey, roundKeys AES_TABLES_ARG);
 
-    cipherText[global_id] = AES_AddRoundKey(state, localExpandedKey[rounds - 1]);
+    for (int b = 0; b < BLOCKS_PER_ITEM; ++b)
+    {
+        const size_t idx = AES_BlockIndex(b);
+        if (idx < blockCount)
+            cipherText[idx] = states[b];
+    }
 }
+#endif
 
+// expandedKey is the decryption key schedule, see AES_Base::invertKeyRounds
 __kernel void AES_ECB_Decrypt(
-    __global __read_only uchar16* restrict cipherText,
+    __global __read_only uchar16* cipherText,
     __global __read_only uchar16* restrict expandedKey,
-    __global __write_only uchar16* restrict plainText,
-    const unsigned int rounds)
+    __global __write_only uchar16* plainText,
+    const unsigned int rounds,
+    const unsigned long blockCount)
 {
+    const unsigned int roundKeys = AES_ROUND_KEY_COUNT(rounds);
     __local uchar16 localExpandedKey[15];
+#ifdef AES_T_TABLES
+    __local uint localTables[4 * 256];
+#endif
 
     event_t cacheEvent;
     cacheEvent = async_work_group_copy(
         localExpandedKey,
         expandedKey,
-        rounds,
+        roundKeys,
         cacheEvent
     );
 
-    const int global_id = get_global_id(0);
-    uchar16 state = cipherText[global_id];
-    wait_group_events(1, &cacheEvent);
+#ifdef AES_T_TABLES
+    AES_FillInverseTTables(localTables);
+#endif
 
-    state = AES_AddRoundKey(state, localExpandedKey[rounds - 1]);
+    wait_group_events(1, &cacheEvent);
+#ifdef AES_T_TABLES
+    // tables are filled by the whole work-group
+    barrier(CLK_LOCAL_MEM_FENCE);
+#endif
 
-    state = AES_InverseShiftRows(state);
-    state = AES_InverseSubBytes(state);
+    // the global size is rounded up to whole work-groups, see LaunchPlanner
+    if (AES_BlockIndex(0) >= blockCount)
+        return;
 
-    for (int i = rounds - 2; i >= 1; --i)
+    // all loads are issued before the first block is decrypted
+    uchar16 states[BLOCKS_PER_ITEM];
+    for (int b = 0; b < BLOCKS_PER_ITEM; ++b)
     {
-        state = AES_AddRoundKey(state, localExpandedKey[i]);
-        state = AES_InverseMixColumns(state);
-        state = AES_InverseShiftRows(state);
-        state = AES_InverseSubBytes(state);
+        const size_t idx = AES_BlockIndex(b);
+        states[b] = idx < blockCount ? cipherText[idx] : (uchar16)(0);
     }
 
-    plainText[global_id] = AES_AddRoundKey(state, localExpandedKey[0]);
+    for (int b = 0; b < BLOCKS_PER_ITEM; ++b)
+        states[b] = AES_Decrypt(states[b], localExpandedKey, roundKeys AES_TABLES_ARG);
+
+    for (int b = 0; b < BLOCKS_PER_ITEM; ++b)
+    {
+        const size_t idx = AES_BlockIndex(b);
+        if (idx < blockCount)
+            plainText[idx] = states[b];
+    }
 }
 
-void AES_CTR_IncrementIC(uchar16* ic, unsigned int id)
+// The counter block is a 128bit big endian integer (NIST SP 800-38A, B.1),
+// adds n to it with the carry going through all 16 bytes. The bytes are
+// assembled explicitly, the result doesn't depend on the device byte order.
+inline void AES_CTR_IncrementIC(uchar16* ic, unsigned long n)
 {
-    // TODO: This will not carry over the last half!
-    //       We need some sort of a uint4_add function.
+    const uchar16 c = *ic;
+    ulong high = upsample(upsample(upsample(c.s0, c.s1), upsample(c.s2, c.s3)),
+                          upsample(upsample(c.s4, c.s5), upsample(c.s6, c.s7)));
+    ulong low = upsample(upsample(upsample(c.s8, c.s9), upsample(c.sA, c.sB)),
+                         upsample(upsample(c.sC, c.sD), upsample(c.sE, c.sF)));
 
-#ifdef LITTLE_ENDIAN
-    // because of endianess we need to flip
-    unsigned long last = (unsigned long)ic->sfedcba98;
-    last += id;
+    low += n;
+    // unsigned overflow wraps, the sum is smaller than n exactly when it did
+    high += low < n ? 1 : 0;
 
-    uchar8* last_uchar8 = (uchar8*)&last;
-    // and then flip it back :-/
-    ic->s89abcdef = last_uchar8->s76543210;
-#else
-    unsigned long* last = (unsigned long*)((uchar8*)ic)[1];
-    *last += id;
-#endif
+    *ic = (uchar16)(
+        (uchar)(high >> 56), (uchar)(high >> 48), (uchar)(high >> 40), (uchar)(high >> 32),
+        (uchar)(high >> 24), (uchar)(high >> 16), (uchar)(high >> 8), (uchar)high,
+        (uchar)(low >> 56), (uchar)(low >> 48), (uchar)(low >> 40), (uchar)(low >> 32),
+        (uchar)(low >> 24), (uchar)(low >> 16), (uchar)(low >> 8), (uchar)low
+    );
 }
 
+#ifndef AES_BITSLICED
 __kernel void AES_CTR_Encrypt(
-    __global __read_only uchar16* restrict plainText,
+    __global __read_only uchar16* plainText,
     __global __read_only uchar16* restrict expandedKey,
     const uchar16 ic,
-    __global __write_only uchar16* restrict cipherText,
-    const unsigned int rounds)
+    __global __write_only uchar16* cipherText,
+    const unsigned int rounds,
+    const unsigned long blockCount,
+    const unsigned long blockOffset)
 {
+    const unsigned int roundKeys = AES_ROUND_KEY_COUNT(rounds);
     __local uchar16 localExpandedKey[15];
+#ifdef AES_T_TABLES
+    __local uint localTables[4 * 256];
+#endif
 
     event_t cacheEvent;
     cacheEvent = async_work_group_copy(
         localExpandedKey,
         expandedKey,
-        rounds,
+        roundKeys,
         cacheEvent
     );
 
-    const int global_id = get_global_id(0);
-    uchar16 state = ic;
-    AES_CTR_IncrementIC(&state, global_id);
-    wait_group_events(1, &cacheEvent);
+#ifdef AES_T_TABLES
+    AES_FillTTables(localTables);
+#endif
 
-    state = AES_AddRoundKey(state, localExpandedKey[0]);
+    // blockOffset counts the blocks of the stream before this chunk, it is
+    // added on its own, offset + index may not fit 64 bits
+    uchar16 chunkCounter = ic;
+    AES_CTR_IncrementIC(&chunkCounter, blockOffset);
 
-    for (int i = 1; i < rounds - 1; ++i)
+    uchar16 states[BLOCKS_PER_ITEM];
+    for (int b = 0; b < BLOCKS_PER_ITEM; ++b)
     {
-        state = AES_SubBytes(state);
-        state = AES_ShiftRows(state);
-        state = AES_MixColumns(state);
-        state = AES_AddRoundKey(state, localExpandedKey[i]);
+        states[b] = chunkCounter;
+        AES_CTR_IncrementIC(&states[b], AES_BlockIndex(b));
     }
+    wait_group_events(1, &cacheEvent);
+#ifdef AES_T_TABLES
+    // tables are filled by the whole work-group
+    barrier(CLK_LOCAL_MEM_FENCE);
+#endif
 
-    state = AES_SubBytes(state);
-    state = AES_ShiftRows(state);
+    // the global size is rounded up to whole work-groups, see LaunchPlanner
+    if (AES_BlockIndex(0) >= blockCount)
+        return;
 
-    cipherText[global_id] = plainText[global_id] ^ AES_AddRoundKey(state, localExpandedKey[rounds - 1]);
+    for (int b = 0; b < BLOCKS_PER_ITEM; ++b)
+        states[b] = AES_Encrypt(states[b], localExpandedKey, roundKeys AES_TABLES_ARG);
+
+    for (int b = 0; b < BLOCKS_PER_ITEM; ++b)
+    {
+        const size_t idx = AES_BlockIndex(b);
+        if (idx < blockCount)
+            cipherText[idx] = plainText[idx] ^ states[b];
+    }
 }
+#endif
 
 void AES_GCM_IncrementIV(uchar16* iv, unsigned int id)
 {
@@ -447,40 +734,421 @@ void AES_GCM_IncrementIV(uchar16* iv, unsigned int id)
 }
 
 __kernel void AES_GCM_Encrypt(
-    __global __read_only uchar16* restrict plainText,
+    __global __read_only uchar16* plainText,
     __global __read_only uchar16* restrict expandedKey,
     const uchar16 iv,
-    __global __write_only uchar16* restrict cipherText,
-    const unsigned int rounds)
+    __global __write_only uchar16* cipherText,
+    const unsigned int rounds,
+    const unsigned long blockCount)
 {
+    const unsigned int roundKeys = AES_ROUND_KEY_COUNT(rounds);
     __local uchar16 localExpandedKey[15];
+#ifdef AES_T_TABLES
+    __local uint localTables[4 * 256];
+#endif
 
     event_t cacheEvent;
     cacheEvent = async_work_group_copy(
         localExpandedKey,
         expandedKey,
-        rounds,
+        roundKeys,
         cacheEvent
     );
 
-    const int global_id = get_global_id(0);
-    uchar16 state = iv;
-    // the first IV is used for auth tag only, we use the second IV to get ciphertext
-    AES_GCM_IncrementIV(&state, global_id + 1);
+#ifdef AES_T_TABLES
+    AES_FillTTables(localTables);
+#endif
+
+    uchar16 states[BLOCKS_PER_ITEM];
+    for (int b = 0; b < BLOCKS_PER_ITEM; ++b)
+    {
+        states[b] = iv;
+        // the first IV is used for auth tag only, we use the second IV to get ciphertext
+        AES_GCM_IncrementIV(&states[b], AES_BlockIndex(b) + 1);
+    }
     wait_group_events(1, &cacheEvent);
+#ifdef AES_T_TABLES
+    // tables are filled by the whole work-group
+    barrier(CLK_LOCAL_MEM_FENCE);
+#endif
 
-    state = AES_AddRoundKey(state, localExpandedKey[0]);
+    // the global size is rounded up to whole work-groups, see LaunchPlanner
+    if (AES_BlockIndex(0) >= blockCount)
+        return;
 
-    for (int i = 1; i < rounds - 1; ++i)
+    for (int b = 0; b < BLOCKS_PER_ITEM; ++b)
+        states[b] = AES_Encrypt(states[b], localExpandedKey, roundKeys AES_TABLES_ARG);
+
+    for (int b = 0; b < BLOCKS_PER_ITEM; ++b)
     {
-        state = AES_SubBytes(state);
-        state = AES_ShiftRows(state);
-        state = AES_MixColumns(state);
-        state = AES_AddRoundKey(state, localExpandedKey[i]);
+        const size_t idx = AES_BlockIndex(b);
+        if (idx < blockCount)
+            cipherText[idx] = plainText[idx] ^ states[b];
     }
+}
 
-    state = AES_SubBytes(state);
-    state = AES_ShiftRows(state);
+#ifdef AES_BITSLICED
+
+// Bitsliced AES, each work-item encrypts AES_BITSLICE_BLOCKS blocks at once
+// using only logical operations. There are no table lookups with secret
+// indices, the running time doesn't depend on the key or the data.
+//
+// The state of all blocks is kept in 128 words, word 8 * byte + bit holds
+// that bit of that state byte for every block, block b in bit b. Getting
+// the blocks in and out of this layout is a 32x32 bit matrix transposition
+// for each 32bit column of the state.
+
+#define AES_BITSLICE_BLOCKS 32
+
+// Hacker's Delight 7-3, swaps bit p of word b with bit b of word p
+inline void AES_BitsliceTranspose32(uint* words)
+{
+    uint mask = 0x0000ffff;
+    for (uint j = 16; j != 0; j >>= 1, mask ^= mask << j)
+    {
+        for (uint k = 0; k < 32; k = (k + j + 1) & ~j)
+        {
+            const uint t = ((words[k] >> j) ^ words[k + j]) & mask;
+            words[k] ^= t << j;
+            words[k + j] ^= t;
+        }
+    }
+}
+
+inline void AES_BitsliceTranspose(uint* slices)
+{
+    for (int k = 0; k < 4; ++k)
+        AES_BitsliceTranspose32(slices + 32 * k);
+}
+
+// puts block b in place for AES_BitsliceTranspose
+inline void AES_BitsliceGather(uint* slices, int b, uchar16 block)
+{
+    const uint4 columns = AES_ToColumns(block);
+    slices[b] = columns.x;
+    slices[32 + b] = columns.y;
+    slices[64 + b] = columns.z;
+    slices[96 + b] = columns.w;
+}
+
+// takes block b out after AES_BitsliceTranspose
+inline uchar16 AES_BitsliceScatter(const uint* slices, int b)
+{
+    return AES_FromColumns((uint4)(slices[b], slices[32 + b], slices[64 + b], slices[96 + b]));
+}
+
+inline void AES_BitslicedAddRoundKey(uint* slices, uchar16 key)
+{
+    uchar bytes[16];
+    vstore16(key, 0, bytes);
+
+    // all ones or all zeros, the same key bit for every block
+    for (int i = 0; i < 16; ++i)
+        for (int j = 0; j < 8; ++j)
+            slices[8 * i + j] ^= -((uint)(bytes[i] >> j) & 1u);
+}
+
+// Boyar and Peralta, "A new combinational logic minimization technique with
+// applications to cryptology", 2010. 113 gates, x[0] is the lowest bit.
+inline void AES_BitslicedSbox(uint* x)
+{
+    const uint U0 = x[7], U1 = x[6], U2 = x[5], U3 = x[4];
+    const uint U4 = x[3], U5 = x[2], U6 = x[1], U7 = x[0];
 
-    cipherText[global_id] = plainText[global_id] ^ AES_AddRoundKey(state, localExpandedKey[rounds - 1]);
+    const uint T1 = U0 ^ U3;
+    const uint T2 = U0 ^ U5;
+    const uint T3 = U0 ^ U6;
+    const uint T4 = U3 ^ U5;
+    const uint T5 = U4 ^ U6;
+    const uint T6 = T1 ^ T5;
+    const uint T7 = U1 ^ U2;
+    const uint T8 = U7 ^ T6;
+    const uint T9 = U7 ^ T7;
+    const uint T10 = T6 ^ T7;
+    const uint T11 = U1 ^ U5;
+    const uint T12 = U2 ^ U5;
+    const uint T13 = T3 ^ T4;
+    const uint T14 = T6 ^ T11;
+    const uint T15 = T5 ^ T11;
+    const uint T16 = T5 ^ T12;
+    const uint T17 = T9 ^ T16;
+    const uint T18 = U3 ^ U7;
+    const uint T19 = T7 ^ T18;
+    const uint T20 = T1 ^ T19;
+    const uint T21 = U6 ^ U7;
+    const uint T22 = T7 ^ T21;
+    const uint T23 = T2 ^ T22;
+    const uint T24 = T2 ^ T10;
+    const uint T25 = T20 ^ T17;
+    const uint T26 = T3 ^ T16;
+    const uint T27 = T1 ^ T12;
+
+    const uint M1 = T13 & T6;
+    const uint M2 = T23 & T8;
+    const uint M3 = T14 ^ M1;
+    const uint M4 = T19 & U7;
+    const uint M5 = M4 ^ M1;
+    const uint M6 = T3 & T16;
+    const uint M7 = T22 & T9;
+    const uint M8 = T26 ^ M6;
+    const uint M9 = T20 & T17;
+    const uint M10 = M9 ^ M6;
+    const uint M11 = T1 & T15;
+    const uint M12 = T4 & T27;
+    const uint M13 = M12 ^ M11;
+    const uint M14 = T2 & T10;
+    const uint M15 = M14 ^ M11;
+    const uint M16 = M3 ^ M2;
+    const uint M17 = M5 ^ T24;
+    const uint M18 = M8 ^ M7;
+    const uint M19 = M10 ^ M15;
+    const uint M20 = M16 ^ M13;
+    const uint M21 = M17 ^ M15;
+    const uint M22 = M18 ^ M13;
+    const uint M23 = M19 ^ T25;
+    const uint M24 = M22 ^ M23;
+    const uint M25 = M22 & M20;
+    const uint M26 = M21 ^ M25;
+    const uint M27 = M20 ^ M21;
+    const uint M28 = M23 ^ M25;
+    const uint M29 = M28 & M27;
+    const uint M30 = M26 & M24;
+    const uint M31 = M20 & M23;
+    const uint M32 = M27 & M31;
+    const uint M33 = M27 ^ M25;
+    const uint M34 = M21 & M22;
+    const uint M35 = M24 & M34;
+    const uint M36 = M24 ^ M25;
+    const uint M37 = M21 ^ M29;
+    const uint M38 = M32 ^ M33;
+    const uint M39 = M23 ^ M30;
+    const uint M40 = M35 ^ M36;
+    const uint M41 = M38 ^ M40;
+    const uint M42 = M37 ^ M39;
+    const uint M43 = M37 ^ M38;
+    const uint M44 = M39 ^ M40;
+    const uint M45 = M42 ^ M41;
+    const uint M46 = M44 & T6;
+    const uint M47 = M40 & T8;
+    const uint M48 = M39 & U7;
+    const uint M49 = M43 & T16;
+    const uint M50 = M38 & T9;
+    const uint M51 = M37 & T17;
+    const uint M52 = M42 & T15;
+    const uint M53 = M45 & T27;
+    const uint M54 = M41 & T10;
+    const uint M55 = M44 & T13;
+    const uint M56 = M40 & T23;
+    const uint M57 = M39 & T19;
+    const uint M58 = M43 & T3;
+    const uint M59 = M38 & T22;
+    const uint M60 = M37 & T20;
+    const uint M61 = M42 & T1;
+    const uint M62 = M45 & T4;
+    const uint M63 = M41 & T2;
+
+    const uint L0 = M61 ^ M62;
+    const uint L1 = M50 ^ M56;
+    const uint L2 = M46 ^ M48;
+    const uint L3 = M47 ^ M55;
+    const uint L4 = M54 ^ M58;
+    const uint L5 = M49 ^ M61;
+    const uint L6 = M62 ^ L5;
+    const uint L7 = M46 ^ L3;
+    const uint L8 = M51 ^ M59;
+    const uint L9 = M52 ^ M53;
+    const uint L10 = M53 ^ L4;
+    const uint L11 = M60 ^ L2;
+    const uint L12 = M48 ^ M51;
+    const uint L13 = M50 ^ L0;
+    const uint L14 = M52 ^ M61;
+    const uint L15 = M55 ^ L1;
+    const uint L16 = M56 ^ L0;
+    const uint L17 = M57 ^ L1;
+    const uint L18 = M58 ^ L8;
+    const uint L19 = M63 ^ L4;
+    const uint L20 = L0 ^ L1;
+    const uint L21 = L1 ^ L7;
+    const uint L22 = L3 ^ L12;
+    const uint L23 = L18 ^ L2;
+    const uint L24 = L15 ^ L9;
+    const uint L25 = L6 ^ L10;
+    const uint L26 = L7 ^ L9;
+    const uint L27 = L8 ^ L10;
+    const uint L28 = L11 ^ L14;
+    const uint L29 = L11 ^ L17;
+
+    x[7] = L6 ^ L24;
+    x[6] = ~(L16 ^ L26);
+    x[5] = ~(L19 ^ L28);
+    x[4] = L6 ^ L21;
+    x[3] = L20 ^ L22;
+    x[2] = L25 ^ L29;
+    x[1] = ~(L13 ^ L27);
+    x[0] = ~(L6 ^ L23);
+}
+
+inline void AES_BitslicedSubBytes(uint* slices)
+{
+    for (int i = 0; i < 16; ++i)
+        AES_BitslicedSbox(slices + 8 * i);
+}
+
+// 2 * x0 ^ 3 * x1 ^ x2 ^ x3, one row of MixColumns
+inline void AES_BitslicedMixRow(const uint* x0, const uint* x1, const uint* x2, const uint* x3, uint* out)
+{
+    uint sum[8];
+    for (int j = 0; j < 8; ++j)
+        sum[j] = x0[j] ^ x1[j];
+
+    // multiplying by 2 shifts the bits up and reduces by 0x11b
+    const uint high = sum[7];
+    for (int j = 0; j < 8; ++j)
+    {
+        const uint doubled = (j == 0 ? 0 : sum[j - 1]) ^ (((0x1b >> j) & 1) ? high : 0);
+        out[j] = doubled ^ x1[j] ^ x2[j] ^ x3[j];
+    }
 }
+
+// ShiftRows followed by MixColumns, row r of column c comes from column c + r
+inline void AES_BitslicedShiftRowsMixColumns(const uint* in, uint* out)
+{
+    for (int c = 0; c < 4; ++c)
+    {
+        const uint* a0 = in + 8 * (4 * ((c + 0) % 4) + 0);
+        const uint* a1 = in + 8 * (4 * ((c + 1) % 4) + 1);
+        const uint* a2 = in + 8 * (4 * ((c + 2) % 4) + 2);
+        const uint* a3 = in + 8 * (4 * ((c + 3) % 4) + 3);
+
+        AES_BitslicedMixRow(a0, a1, a2, a3, out + 8 * (4 * c + 0));
+        AES_BitslicedMixRow(a1, a2, a3, a0, out + 8 * (4 * c + 1));
+        AES_BitslicedMixRow(a2, a3, a0, a1, out + 8 * (4 * c + 2));
+        AES_BitslicedMixRow(a3, a0, a1, a2, out + 8 * (4 * c + 3));
+    }
+}
+
+inline void AES_BitslicedShiftRows(const uint* in, uint* out)
+{
+    for (int c = 0; c < 4; ++c)
+        for (int r = 0; r < 4; ++r)
+            for (int j = 0; j < 8; ++j)
+                out[8 * (4 * c + r) + j] = in[8 * (4 * ((c + r) % 4) + r) + j];
+}
+
+inline void AES_BitslicedEncrypt(uint* slices, __local const uchar16* keys, const unsigned int roundKeys)
+{
+    uint mixed[128];
+
+    AES_BitslicedAddRoundKey(slices, keys[0]);
+
+    for (int i = 1; i < roundKeys - 1; ++i)
+    {
+        AES_BitslicedSubBytes(slices);
+        AES_BitslicedShiftRowsMixColumns(slices, mixed);
+
+        for (int j = 0; j < 128; ++j)
+            slices[j] = mixed[j];
+
+        AES_BitslicedAddRoundKey(slices, keys[i]);
+    }
+
+    AES_BitslicedSubBytes(slices);
+    AES_BitslicedShiftRows(slices, mixed);
+
+    for (int j = 0; j < 128; ++j)
+        slices[j] = mixed[j];
+
+    AES_BitslicedAddRoundKey(slices, keys[roundKeys - 1]);
+}
+
+// plainText and cipherText may be the same buffer in in-place mode,
+// they must not be declared restrict
+__kernel void AES_ECB_Encrypt(
+    __global __read_only uchar16* plainText,
+    __global __read_only uchar16* restrict expandedKey,
+    __global __write_only uchar16* cipherText,
+    const unsigned int rounds,
+    const unsigned long blockCount)
+{
+    const unsigned int roundKeys = AES_ROUND_KEY_COUNT(rounds);
+    __local uchar16 localExpandedKey[15];
+
+    event_t cacheEvent;
+    cacheEvent = async_work_group_copy(
+        localExpandedKey,
+        expandedKey,
+        roundKeys,
+        cacheEvent
+    );
+
+    const size_t first = get_global_id(0) * AES_BITSLICE_BLOCKS;
+    wait_group_events(1, &cacheEvent);
+
+    // blockCount is the number of blocks, not of work-items, see LaunchPlanner
+    if (first >= blockCount)
+        return;
+
+    const int count = (int)min((unsigned long)AES_BITSLICE_BLOCKS, blockCount - first);
+
+    uint slices[128];
+    for (int b = 0; b < AES_BITSLICE_BLOCKS; ++b)
+        AES_BitsliceGather(slices, b, b < count ? plainText[first + b] : (uchar16)(0));
+
+    AES_BitsliceTranspose(slices);
+    AES_BitslicedEncrypt(slices, localExpandedKey, roundKeys);
+    AES_BitsliceTranspose(slices);
+
+    for (int b = 0; b < count; ++b)
+        cipherText[first + b] = AES_BitsliceScatter(slices, b);
+}
+
+__kernel void AES_CTR_Encrypt(
+    __global __read_only uchar16* plainText,
+    __global __read_only uchar16* restrict expandedKey,
+    const uchar16 ic,
+    __global __write_only uchar16* cipherText,
+    const unsigned int rounds,
+    const unsigned long blockCount,
+    const unsigned long blockOffset)
+{
+    const unsigned int roundKeys = AES_ROUND_KEY_COUNT(rounds);
+    __local uchar16 localExpandedKey[15];
+
+    event_t cacheEvent;
+    cacheEvent = async_work_group_copy(
+        localExpandedKey,
+        expandedKey,
+        roundKeys,
+        cacheEvent
+    );
+
+    const size_t first = get_global_id(0) * AES_BITSLICE_BLOCKS;
+    wait_group_events(1, &cacheEvent);
+
+    // blockCount is the number of blocks, not of work-items, see LaunchPlanner
+    if (first >= blockCount)
+        return;
+
+    const int count = (int)min((unsigned long)AES_BITSLICE_BLOCKS, blockCount - first);
+
+    // offset + index may not fit 64 bits, see the table based AES_CTR_Encrypt
+    uchar16 chunkCounter = ic;
+    AES_CTR_IncrementIC(&chunkCounter, blockOffset);
+
+    uint slices[128];
+    for (int b = 0; b < AES_BITSLICE_BLOCKS; ++b)
+    {
+        uchar16 counter = chunkCounter;
+        AES_CTR_IncrementIC(&counter, first + b);
+        AES_BitsliceGather(slices, b, counter);
+    }
+
+    AES_BitsliceTranspose(slices);
+    AES_BitslicedEncrypt(slices, localExpandedKey, roundKeys);
+    AES_BitsliceTranspose(slices);
+
+    for (int b = 0; b < count; ++b)
+        cipherText[first + b] = plainText[first + b] ^ AES_BitsliceScatter(slices, b);
+}
+
+#endif
@@ -38,11 +38,11 @@ inline void BLOWFISH_SplitBlock(const unsigned long* block, unsigned int* left,
 #endif
 }
 
-inline void BLOWFISH_WriteResultBlock(const unsigned long* block, __global __write_only unsigned long* restrict ret)
+inline void BLOWFISH_WriteResultBlock(const unsigned long* block, __global __write_only unsigned long* ret)
 {
 #ifdef LITTLE_ENDIAN
     const uchar8* block_uc = (const uchar8*)block;
-    __global uchar8* restrict ret_uc = (__global uchar8* restrict)ret;
+    __global uchar8* ret_uc = (__global uchar8*)ret;
 
     ret_uc->s76543210 = block_uc->s01234567;
 #else
@@ -70,11 +70,52 @@ inline unsigned long BLOWFISH_f(unsigned int x, __local unsigned int* restrict s
     return ret;
 }
 
+// Each work-item handles BLOCKS_PER_ITEM blocks, the host picks the number for
+// each device, see Device::getBlocksPerWorkItem. Work-items of a group take
+// every local size-th block of the group's range, just like in aes.c.
+#ifndef BLOCKS_PER_ITEM
+#   define BLOCKS_PER_ITEM 1
+#endif
+
+// index of block b of this work-item
+inline size_t BLOWFISH_BlockIndex(int b)
+{
+    const size_t groupStart = (get_global_id(0) - get_local_id(0)) * BLOCKS_PER_ITEM;
+    return groupStart + b * get_local_size(0) + get_local_id(0);
+}
+
+inline unsigned long BLOWFISH_Encrypt(unsigned long block, __local unsigned int* restrict p,
+                                      __local unsigned int* restrict sboxes)
+{
+    unsigned int left;
+    unsigned int right;
+    BLOWFISH_SplitBlock(&block, &left, &right);
+
+    left ^= p[0];
+    // I had compiler error problems with pocl just porting the key schedule
+    // code with swaps. That's why the i += 2 variant is used here, without
+    // swaps. It's a little bit less readable but works on all the platforms.
+    for (int i = 1; i < 16; i += 2)
+    {
+        right ^= p[i];
+        right ^= BLOWFISH_f(left, sboxes);
+        left ^= p[i + 1];
+        left ^= BLOWFISH_f(right, sboxes);
+    }
+    right ^= p[16 + 1];
+
+    // fuse the block back
+    return ((unsigned long)right) << 32 | left;
+}
+
+// plainText and cipherText may be the same buffer in in-place mode,
+// they must not be declared restrict
 __kernel void BLOWFISH_ECB_Encrypt(
-    __global __read_only unsigned long* restrict plainText,
+    __global __read_only unsigned long* plainText,
     __global __read_only unsigned int* restrict p,
     __global __read_only unsigned int* restrict sboxes,
-    __global __write_only unsigned long* restrict cipherText)
+    __global __write_only unsigned long* cipherText,
+    const unsigned long blockCount)
 {
     __local unsigned int localP[18];
     __local unsigned int localSboxes[4*256];
@@ -95,30 +136,28 @@ __kernel void BLOWFISH_ECB_Encrypt(
         cacheEvent
     );
 
-    const int global_id = get_global_id(0);
-    unsigned long block = plainText[global_id];
-
-    unsigned int left;
-    unsigned int right;
-    BLOWFISH_SplitBlock(&block, &left, &right);
-
     wait_group_events(1, &cacheEvent);
 
-    left ^= localP[0];
-    // I had compiler error problems with pocl just porting the key schedule
-    // code with swaps. That's why the i += 2 variant is used here, without
-    // swaps. It's a little bit less readable but works on all the platforms.
-    for (int i = 1; i < 16; i += 2)
+    // the global size is rounded up to whole work-groups, see LaunchPlanner
+    if (BLOWFISH_BlockIndex(0) >= blockCount)
+        return;
+
+    // all loads are issued before the first block is encrypted
+    unsigned long blocks[BLOCKS_PER_ITEM];
+    for (int b = 0; b < BLOCKS_PER_ITEM; ++b)
     {
-        right ^= localP[i];
-        right ^= BLOWFISH_f(left, localSboxes);
-        left ^= localP[i + 1];
-        left ^= BLOWFISH_f(right, localSboxes);
+        const size_t idx = BLOWFISH_BlockIndex(b);
+        blocks[b] = idx < blockCount ? plainText[idx] : 0;
     }
-    right ^= localP[16 + 1];
 
-    // fuse the block back
-    block = ((unsigned long)right) << 32 | left;
-    // use this function to avoid endianess issues
-    BLOWFISH_WriteResultBlock(&block, &cipherText[global_id]);
+    for (int b = 0; b < BLOCKS_PER_ITEM; ++b)
+        blocks[b] = BLOWFISH_Encrypt(blocks[b], localP, localSboxes);
+
+    for (int b = 0; b < BLOCKS_PER_ITEM; ++b)
+    {
+        const size_t idx = BLOWFISH_BlockIndex(b);
+        // use this function to avoid endianess issues
+        if (idx < blockCount)
+            BLOWFISH_WriteResultBlock(&blocks[b], &cipherText[idx]);
+    }
 }
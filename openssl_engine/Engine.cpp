@@ -88,23 +88,15 @@ static int oclcrypto_aes_ecb_do_cipher(EVP_CIPHER_CTX* ctx, unsigned char* out_a
         {
             oclcrypto::AES_ECB_Encrypt* context = reinterpret_cast<oclcrypto::AES_ECB_Encrypt*>(ctx->cipher_data);
             context->setPlainText(in_arg, nbytes);
-            context->execute(128); // TODO: arbitrary
-            {
-                auto data = context->getCipherText()->lockRead<unsigned char>();
-                for (size_t j = 0; j < data.size(); ++j)
-                    out_arg[j] = data[j];
-            }
+            context->execute();
+            context->getCipherText()->read(out_arg, nbytes);
         }
         else
         {
             oclcrypto::AES_ECB_Decrypt* context = reinterpret_cast<oclcrypto::AES_ECB_Decrypt*>(ctx->cipher_data);
             context->setCipherText(in_arg, nbytes);
-            context->execute(128); // TODO: arbitrary
-            {
-                auto data = context->getPlainText()->lockRead<unsigned char>();
-                for (size_t j = 0; j < data.size(); ++j)
-                    out_arg[j] = data[j];
-            }
+            context->execute();
+            context->getPlainText()->read(out_arg, nbytes);
         }
     }
 
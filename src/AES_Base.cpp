@@ -27,7 +27,10 @@
 #include "oclcrypto/Device.h"
 #include "oclcrypto/DataBuffer.h"
 #include "oclcrypto/System.h"
+#include "oclcrypto/Program.h"
+#include "oclcrypto/Kernel.h"
 
+#include <algorithm>
 #include <cassert>
 #include <string>
 
@@ -227,18 +230,65 @@ unsigned char* AES_Base::expandKeyRounds(const unsigned char* key, size_t keySiz
     return ret.release();
 }
 
-AES_Base::AES_Base(System &system, Device &device):
+// multiplication in GF(2^8) modulo the AES polynomial x^8 + x^4 + x^3 + x + 1
+static inline unsigned char invertKeyRounds_multiply(unsigned char a, unsigned char b)
+{
+    unsigned char ret = 0;
+    while (b)
+    {
+        if (b & 1)
+            ret ^= a;
+
+        a = static_cast<unsigned char>((a << 1) ^ ((a & 0x80) ? 0x1b : 0x00));
+        b >>= 1;
+    }
+
+    return ret;
+}
+
+void AES_Base::invertKeyRounds(unsigned char* expandedKey, unsigned short rounds)
+{
+    // the first and the last round key are added without any MixColumns
+    for (size_t c = 16; c + 16 < rounds * 16u; c += 4)
+    {
+        unsigned char* column = expandedKey + c;
+        const unsigned char a0 = column[0], a1 = column[1], a2 = column[2], a3 = column[3];
+
+        column[0] = invertKeyRounds_multiply(a0, 14) ^ invertKeyRounds_multiply(a1, 11) ^
+                    invertKeyRounds_multiply(a2, 13) ^ invertKeyRounds_multiply(a3, 9);
+        column[1] = invertKeyRounds_multiply(a0, 9) ^ invertKeyRounds_multiply(a1, 14) ^
+                    invertKeyRounds_multiply(a2, 11) ^ invertKeyRounds_multiply(a3, 13);
+        column[2] = invertKeyRounds_multiply(a0, 13) ^ invertKeyRounds_multiply(a1, 9) ^
+                    invertKeyRounds_multiply(a2, 14) ^ invertKeyRounds_multiply(a3, 11);
+        column[3] = invertKeyRounds_multiply(a0, 11) ^ invertKeyRounds_multiply(a1, 13) ^
+                    invertKeyRounds_multiply(a2, 9) ^ invertKeyRounds_multiply(a3, 14);
+    }
+}
+
+AES_Base::AES_Base(System &system, Device &device, bool decryption):
     mSystem(system),
     mDevice(device),
+    mQueueIndex(device.acquireQueue()),
 
+    mDecryption(decryption),
     mRounds(0),
-    mExpandedKey(nullptr)
+    mExpandedKey(nullptr),
+    mImplementation(BYTEWISE),
+
+    mKernel(nullptr),
+    mKernelKeyBound(false),
+    mKernelRounds(0),
+    mKernelImplementation(BYTEWISE),
+    mKernelBlocksPerWorkItem(1)
 {}
 
 AES_Base::~AES_Base()
 {
     try
     {
+        if (mKernel)
+            mKernel->getProgram().destroyKernel(*mKernel);
+
         if (mExpandedKey)
             mDevice.deallocateBuffer(*mExpandedKey);
     }
@@ -257,20 +307,88 @@ void AES_Base::setKey(const unsigned char* key, size_t size)
         throw std::invalid_argument("Can't use given key of size " + std::to_string(size) + ". Make sure key size is 16, 24 or 32 (in bytes).");
 
     std::unique_ptr<unsigned char[]> expandedKey(expandKeyRounds(key, size, mRounds));
+    if (mDecryption)
+        invertKeyRounds(expandedKey.get(), mRounds);
 
-    if (!mExpandedKey || mExpandedKey->getArraySize<unsigned char>() != size)
+    if (!mExpandedKey || mExpandedKey->getArraySize<unsigned char>() != mRounds * 16u)
     {
         if (mExpandedKey)
             mDevice.deallocateBuffer(*mExpandedKey);
 
         mExpandedKey = &mDevice.allocateBuffer<unsigned char>(mRounds * 16, DataBuffer::Read);
+        mExpandedKey->setQueueIndex(mQueueIndex);
+    }
+
+    {
+        auto data = mExpandedKey->lockOverwrite<unsigned char>();
+        std::copy(expandedKey.get(), expandedKey.get() + mRounds * 16, data.begin());
+    }
+
+    // the buffer or the number of rounds may have changed
+    mKernelKeyBound = false;
+}
+
+void AES_Base::setQueueIndex(size_t idx)
+{
+    mQueueIndex = idx;
+}
+
+void AES_Base::setImplementation(Implementation implementation)
+{
+    mImplementation = implementation;
+}
+
+Kernel& AES_Base::prepareKernel(const char* name, cl_uint keyIndex, cl_uint roundsIndex)
+{
+    const size_t blocksPerWorkItem = mDevice.getBlocksPerWorkItem();
+
+    if (mKernel && (mKernelRounds != mRounds || mKernelImplementation != mImplementation ||
+                    mKernelBlocksPerWorkItem != blocksPerWorkItem))
+    {
+        // the kernel comes from a program specialized for another key size,
+        // implementation or number of blocks per work-item
+        mKernel->getProgram().destroyKernel(*mKernel);
+        mKernel = nullptr;
     }
 
+    if (!mKernel)
     {
-        auto data = mExpandedKey->lockWrite<unsigned char>();
-        for (size_t i = 0; i < mRounds * 16; ++i)
-            data[i] = expandedKey[i];
+        ProgramSources::Defines defines;
+        defines["AES_ROUNDS"] = std::to_string(mRounds);
+        if (mImplementation == T_TABLES)
+            defines["AES_T_TABLES"] = "";
+        else if (mImplementation == BITSLICED)
+            defines["AES_BITSLICED"] = "";
+        // explicitly, the device may change its number while we build
+        defines["BLOCKS_PER_ITEM"] = std::to_string(blocksPerWorkItem);
+
+        Program& program = mSystem.getProgramFromCache(mDevice, ProgramSources::AES, defines);
+        mKernel = &program.createKernel(name);
+        mKernelRounds = mRounds;
+        mKernelImplementation = mImplementation;
+        mKernelBlocksPerWorkItem = blocksPerWorkItem;
+        mKernelKeyBound = false;
     }
+
+    assert(mKernel->getName() == name);
+
+    mKernel->setQueueIndex(mQueueIndex);
+    mExpandedKey->setQueueIndex(mQueueIndex);
+
+    if (!mKernelKeyBound)
+    {
+        mKernel->setParameter(keyIndex, *mExpandedKey);
+        mKernel->setParameter(roundsIndex, &mKernelRounds);
+        mKernelKeyBound = true;
+    }
+
+    return *mKernel;
+}
+
+size_t AES_Base::getBlocksPerWorkItem() const
+{
+    // one block per bit of the uint slices, see AES_BITSLICE_BLOCKS in aes.c
+    return mImplementation == BITSLICED ? 32 : mKernelBlocksPerWorkItem;
 }
 
 }
@@ -30,6 +30,7 @@
 #include "oclcrypto/Kernel.h"
 #include "oclcrypto/System.h"
 
+#include <algorithm>
 #include <cassert>
 #include <string>
 
@@ -39,25 +40,13 @@ namespace oclcrypto
 AES_CTR_Encrypt::AES_CTR_Encrypt(System& system, Device& device):
     AES_Base(system, device),
 
-    mPlainText(nullptr),
-    mCipherText(nullptr)
+    mBlockOffset(0),
+
+    mTexts(device, 16, "AES", false)
 {}
 
 AES_CTR_Encrypt::~AES_CTR_Encrypt()
-{
-    try
-    {
-        if (mPlainText)
-            mDevice.deallocateBuffer(*mPlainText);
-
-        if (mCipherText)
-            mDevice.deallocateBuffer(*mCipherText);
-    }
-    catch (...)
-    {
-        // TODO: log?
-    }
-}
+{}
 
 void AES_CTR_Encrypt::setInitialCounter(const unsigned char ic[16])
 {
@@ -65,68 +54,57 @@ void AES_CTR_Encrypt::setInitialCounter(const unsigned char ic[16])
         reinterpret_cast<unsigned char*>(&mIC)[i] = ic[i];
 }
 
-void AES_CTR_Encrypt::setPlainText(const unsigned char* plaintext, size_t size)
+void AES_CTR_Encrypt::setBlockOffset(cl_ulong offset)
 {
-    if (plaintext == nullptr)
-        throw std::invalid_argument("Non-null plaintext is required");
-
-    if (size == 0)
-        throw std::invalid_argument("Make sure plaintext size greater than 0");
-
-    if (size % 16 != 0)
-        throw std::invalid_argument("Plaintext has to be padded to make full AES blocks. "
-                                    "Its size has to be a multiple of 16.");
-
-    if (!mPlainText || mPlainText->getArraySize<unsigned char>() != size)
-    {
-        if (mPlainText)
-            mDevice.deallocateBuffer(*mPlainText);
+    mBlockOffset = offset;
+}
 
-        mPlainText = &mDevice.allocateBuffer<unsigned char>(size, DataBuffer::Read);
-    }
+void AES_CTR_Encrypt::setPlainText(const unsigned char* plaintext, size_t size)
+{
+    mTexts.setInput(plaintext, size, mQueueIndex);
+}
 
-    {
-        auto data = mPlainText->lockWrite<unsigned char>();
-        for (size_t i = 0; i < size; ++i)
-            data[i] = plaintext[i];
-    }
+bool AES_CTR_Encrypt::wrapPlainText(const unsigned char* plaintext, size_t size)
+{
+    return mTexts.wrapInput(plaintext, size, mQueueIndex);
+}
 
-    if (!mCipherText || mCipherText->getArraySize<unsigned char>() != size)
-    {
-        if (mCipherText)
-            mDevice.deallocateBuffer(*mCipherText);
+void AES_CTR_Encrypt::setPlainTextView(DataBuffer& buffer, size_t offset, size_t size)
+{
+    mTexts.setInputView(buffer, offset, size, mQueueIndex);
+}
 
-        mCipherText = &mDevice.allocateBuffer<unsigned char>(size, DataBuffer::Write);
-    }
+void AES_CTR_Encrypt::setInPlace(bool inPlace)
+{
+    mTexts.setInPlace(inPlace);
 }
 
-void AES_CTR_Encrypt::execute(size_t localWorkSize)
+Event AES_CTR_Encrypt::execute(size_t localWorkSize, const EventList& waitList)
 {
     if (!mExpandedKey)
         throw std::runtime_error("Key has not been set.");
 
-    if (!mPlainText)
+    if (!mTexts.getInput())
         throw std::runtime_error("Plaintext has not been set.");
 
-    if (!mCipherText)
+    if (!mTexts.getOutput())
         throw std::runtime_error("CipherText buffer has not been allocated! This is most likely a bug.");
 
-    Program& program = mSystem.getProgramFromCache(mDevice, ProgramSources::AES);
-    const cl_uint rounds = mRounds;
-
-    const cl_uint plainTextSize = mPlainText->getArraySize<unsigned char>();
+    const size_t plainTextSize = mTexts.getInput()->getArraySize<unsigned char>();
     assert(plainTextSize % 16 == 0);
-    const cl_uint blockCount = plainTextSize / 16;
+    const size_t blockCount = plainTextSize / 16;
+
+    // follow the queue of the cipher in case it has been changed
+    mTexts.setQueueIndex(mQueueIndex);
 
-    ScopedKernel kernel(program.createKernel("AES_CTR_Encrypt"));
+    Kernel& kernel = prepareKernel("AES_CTR_Encrypt", 1, 4);
 
-    kernel->setParameter(0, *mPlainText);
-    kernel->setParameter(1, *mExpandedKey);
-    kernel->setParameter(2, &mIC);
-    kernel->setParameter(3, *mCipherText);
-    kernel->setParameter(4, &rounds);
+    kernel.setParameter(0, *mTexts.getInput());
+    kernel.setParameter(2, &mIC);
+    kernel.setParameter(3, *mTexts.getOutput());
+    kernel.setParameter(6, &mBlockOffset);
 
-    kernel->execute(blockCount, localWorkSize, false);
+    return kernel.executeBounded(blockCount, localWorkSize, 5, false, waitList, getBlocksPerWorkItem());
 }
 
 }
@@ -30,6 +30,7 @@
 #include "oclcrypto/Kernel.h"
 #include "oclcrypto/System.h"
 
+#include <algorithm>
 #include <cassert>
 #include <string>
 
@@ -39,173 +40,114 @@ namespace oclcrypto
 AES_ECB_Encrypt::AES_ECB_Encrypt(System& system, Device& device):
     AES_Base(system, device),
 
-    mPlainText(nullptr),
-    mCipherText(nullptr)
+    mTexts(device, 16, "AES", false)
 {}
 
 AES_ECB_Encrypt::~AES_ECB_Encrypt()
-{
-    try
-    {
-        if (mPlainText)
-            mDevice.deallocateBuffer(*mPlainText);
-
-        if (mCipherText)
-            mDevice.deallocateBuffer(*mCipherText);
-    }
-    catch (...)
-    {
-        // TODO: log?
-    }
-}
+{}
 
 void AES_ECB_Encrypt::setPlainText(const unsigned char* plaintext, size_t size)
 {
-    if (plaintext == nullptr)
-        throw std::invalid_argument("Non-null plaintext is required");
-
-    if (size == 0)
-        throw std::invalid_argument("Make sure plaintext size greater than 0");
-
-    if (size % 16 != 0)
-        throw std::invalid_argument("Plaintext has to be padded to make full AES blocks. "
-                                    "Its size has to be a multiple of 16.");
-
-    if (!mPlainText || mPlainText->getArraySize<unsigned char>() != size)
-    {
-        if (mPlainText)
-            mDevice.deallocateBuffer(*mPlainText);
-
-        mPlainText = &mDevice.allocateBuffer<unsigned char>(size, DataBuffer::Read);
-    }
+    mTexts.setInput(plaintext, size, mQueueIndex);
+}
 
-    {
-        auto data = mPlainText->lockWrite<unsigned char>();
-        for (size_t i = 0; i < size; ++i)
-            data[i] = plaintext[i];
-    }
+bool AES_ECB_Encrypt::wrapPlainText(const unsigned char* plaintext, size_t size)
+{
+    return mTexts.wrapInput(plaintext, size, mQueueIndex);
+}
 
-    if (!mCipherText || mCipherText->getArraySize<unsigned char>() != size)
-    {
-        if (mCipherText)
-            mDevice.deallocateBuffer(*mCipherText);
+void AES_ECB_Encrypt::setPlainTextView(DataBuffer& buffer, size_t offset, size_t size)
+{
+    mTexts.setInputView(buffer, offset, size, mQueueIndex);
+}
 
-        mCipherText = &mDevice.allocateBuffer<unsigned char>(size, DataBuffer::Write);
-    }
+void AES_ECB_Encrypt::setInPlace(bool inPlace)
+{
+    mTexts.setInPlace(inPlace);
 }
 
-void AES_ECB_Encrypt::execute(size_t localWorkSize)
+Event AES_ECB_Encrypt::execute(size_t localWorkSize, const EventList& waitList)
 {
     if (!mExpandedKey)
         throw std::runtime_error("Key has not been set.");
 
-    if (!mPlainText)
+    if (!mTexts.getInput())
         throw std::runtime_error("Plaintext has not been set.");
 
-    if (!mCipherText)
+    if (!mTexts.getOutput())
         throw std::runtime_error("CipherText buffer has not been allocated! This is most likely a bug.");
 
-    Program& program = mSystem.getProgramFromCache(mDevice, ProgramSources::AES);
-    const cl_uint rounds = mRounds;
-
-    const cl_uint plainTextSize = mPlainText->getArraySize<unsigned char>();
+    const size_t plainTextSize = mTexts.getInput()->getArraySize<unsigned char>();
     assert(plainTextSize % 16 == 0);
-    const cl_uint blockCount = plainTextSize / 16;
+    const size_t blockCount = plainTextSize / 16;
 
-    ScopedKernel kernel(program.createKernel("AES_ECB_Encrypt"));
+    // follow the queue of the cipher in case it has been changed
+    mTexts.setQueueIndex(mQueueIndex);
 
-    kernel->setParameter(0, *mPlainText);
-    kernel->setParameter(1, *mExpandedKey);
-    kernel->setParameter(2, *mCipherText);
-    kernel->setParameter(3, &rounds);
+    Kernel& kernel = prepareKernel("AES_ECB_Encrypt", 1, 3);
 
-    kernel->execute(blockCount, localWorkSize, false);
+    kernel.setParameter(0, *mTexts.getInput());
+    kernel.setParameter(2, *mTexts.getOutput());
+
+    return kernel.executeBounded(blockCount, localWorkSize, 4, false, waitList, getBlocksPerWorkItem());
 }
 
 AES_ECB_Decrypt::AES_ECB_Decrypt(System& system, Device& device):
-    AES_Base(system, device),
+    AES_Base(system, device, true),
 
-    mCipherText(nullptr),
-    mPlainText(nullptr)
+    mTexts(device, 16, "AES", true)
 {}
 
 AES_ECB_Decrypt::~AES_ECB_Decrypt()
-{
-    try
-    {
-        if (mCipherText)
-            mDevice.deallocateBuffer(*mCipherText);
-
-        if (mPlainText)
-            mDevice.deallocateBuffer(*mPlainText);
-    }
-    catch (...)
-    {
-        // TODO: log?
-    }
-}
+{}
 
 void AES_ECB_Decrypt::setCipherText(const unsigned char* ciphertext, size_t size)
 {
-    if (ciphertext == nullptr)
-        throw std::invalid_argument("Non-null ciphertext is required");
-
-    if (size == 0)
-        throw std::invalid_argument("Make sure ciphertext size greater than 0");
-
-    if (size % 16 != 0)
-        throw std::invalid_argument("Ciphertext has to be padded to make full AES blocks. "
-                                    "Its size has to be a multiple of 16.");
-
-    if (!mCipherText || mCipherText->getArraySize<unsigned char>() != size)
-    {
-        if (mCipherText)
-            mDevice.deallocateBuffer(*mCipherText);
-
-        mCipherText = &mDevice.allocateBuffer<unsigned char>(size, DataBuffer::Read);
-    }
+    mTexts.setInput(ciphertext, size, mQueueIndex);
+}
 
-    {
-        auto data = mCipherText->lockWrite<unsigned char>();
-        for (size_t i = 0; i < size; ++i)
-            data[i] = ciphertext[i];
-    }
+bool AES_ECB_Decrypt::wrapCipherText(const unsigned char* ciphertext, size_t size)
+{
+    return mTexts.wrapInput(ciphertext, size, mQueueIndex);
+}
 
-    if (!mPlainText || mPlainText->getArraySize<unsigned char>() != size)
-    {
-        if (mPlainText)
-            mDevice.deallocateBuffer(*mPlainText);
+void AES_ECB_Decrypt::setCipherTextView(DataBuffer& buffer, size_t offset, size_t size)
+{
+    mTexts.setInputView(buffer, offset, size, mQueueIndex);
+}
 
-        mPlainText = &mDevice.allocateBuffer<unsigned char>(size, DataBuffer::Write);
-    }
+void AES_ECB_Decrypt::setInPlace(bool inPlace)
+{
+    mTexts.setInPlace(inPlace);
 }
 
-void AES_ECB_Decrypt::execute(size_t localWorkSize)
+Event AES_ECB_Decrypt::execute(size_t localWorkSize, const EventList& waitList)
 {
+    if (mImplementation == BITSLICED)
+        throw std::invalid_argument("AES ECB decryption has no bitsliced implementation.");
+
     if (!mExpandedKey)
         throw std::runtime_error("Key has not been set.");
 
-    if (!mCipherText)
+    if (!mTexts.getInput())
         throw std::runtime_error("CipherText has not been set.");
 
-    if (!mPlainText)
+    if (!mTexts.getOutput())
         throw std::runtime_error("PlainText buffer has not been allocated! This is most likely a bug.");
 
-    Program& program = mSystem.getProgramFromCache(mDevice, ProgramSources::AES);
-    cl_uint rounds = mRounds;
-
-    const cl_uint cipherTextSize = mCipherText->getArraySize<unsigned char>();
+    const size_t cipherTextSize = mTexts.getInput()->getArraySize<unsigned char>();
     assert(cipherTextSize % 16 == 0);
-    const cl_uint blockCount = cipherTextSize / 16;
+    const size_t blockCount = cipherTextSize / 16;
+
+    // follow the queue of the cipher in case it has been changed
+    mTexts.setQueueIndex(mQueueIndex);
 
-    ScopedKernel kernel(program.createKernel("AES_ECB_Decrypt"));
+    Kernel& kernel = prepareKernel("AES_ECB_Decrypt", 1, 3);
 
-    kernel->setParameter(0, *mCipherText);
-    kernel->setParameter(1, *mExpandedKey);
-    kernel->setParameter(2, *mPlainText);
-    kernel->setParameter(3, &rounds);
+    kernel.setParameter(0, *mTexts.getInput());
+    kernel.setParameter(2, *mTexts.getOutput());
 
-    kernel->execute(blockCount, localWorkSize, false);
+    return kernel.executeBounded(blockCount, localWorkSize, 4, false, waitList, getBlocksPerWorkItem());
 }
 
 }
@@ -30,6 +30,7 @@
 #include "oclcrypto/Kernel.h"
 #include "oclcrypto/System.h"
 
+#include <algorithm>
 #include <cassert>
 #include <string>
 
@@ -39,25 +40,13 @@ namespace oclcrypto
 AES_GCM_Encrypt::AES_GCM_Encrypt(System& system, Device& device):
     AES_Base(system, device),
 
-    mPlainText(nullptr),
-    mCipherText(nullptr)
+    mTexts(device, 16, "AES", false)
 {}
 
 AES_GCM_Encrypt::~AES_GCM_Encrypt()
-{
-    try
-    {
-        if (mPlainText)
-            mDevice.deallocateBuffer(*mPlainText);
-
-        if (mCipherText)
-            mDevice.deallocateBuffer(*mCipherText);
-    }
-    catch (...)
-    {
-        // TODO: log?
-    }
-}
+{}
+
+const size_t AES_GCM_Encrypt::MaxBlockCount;
 
 void AES_GCM_Encrypt::setInitialVector(const unsigned char iv[12])
 {
@@ -70,66 +59,62 @@ void AES_GCM_Encrypt::setInitialVector(const unsigned char iv[12])
 
 void AES_GCM_Encrypt::setPlainText(const unsigned char* plaintext, size_t size)
 {
-    if (plaintext == nullptr)
-        throw std::invalid_argument("Non-null plaintext is required");
-
-    if (size == 0)
-        throw std::invalid_argument("Make sure plaintext size greater than 0");
-
-    if (size % 16 != 0)
-        throw std::invalid_argument("Plaintext has to be padded to make full AES blocks. "
-                                    "Its size has to be a multiple of 16.");
-
-    if (!mPlainText || mPlainText->getArraySize<unsigned char>() != size)
-    {
-        if (mPlainText)
-            mDevice.deallocateBuffer(*mPlainText);
+    checkBlockCount(size);
+    mTexts.setInput(plaintext, size, mQueueIndex);
+}
 
-        mPlainText = &mDevice.allocateBuffer<unsigned char>(size, DataBuffer::Read);
-    }
+bool AES_GCM_Encrypt::wrapPlainText(const unsigned char* plaintext, size_t size)
+{
+    checkBlockCount(size);
+    return mTexts.wrapInput(plaintext, size, mQueueIndex);
+}
 
-    {
-        auto data = mPlainText->lockWrite<unsigned char>();
-        for (size_t i = 0; i < size; ++i)
-            data[i] = plaintext[i];
-    }
+void AES_GCM_Encrypt::setPlainTextView(DataBuffer& buffer, size_t offset, size_t size)
+{
+    checkBlockCount(size);
+    mTexts.setInputView(buffer, offset, size, mQueueIndex);
+}
 
-    if (!mCipherText || mCipherText->getArraySize<unsigned char>() != size)
-    {
-        if (mCipherText)
-            mDevice.deallocateBuffer(*mCipherText);
+void AES_GCM_Encrypt::setInPlace(bool inPlace)
+{
+    mTexts.setInPlace(inPlace);
+}
 
-        mCipherText = &mDevice.allocateBuffer<unsigned char>(size, DataBuffer::Write);
-    }
+void AES_GCM_Encrypt::checkBlockCount(size_t size)
+{
+    if (size / 16 > MaxBlockCount)
+        throw std::invalid_argument("Plaintext is too long, GCM can encrypt at most " +
+                                    std::to_string(MaxBlockCount) + " blocks with one IV.");
 }
 
-void AES_GCM_Encrypt::execute(size_t localWorkSize)
+Event AES_GCM_Encrypt::execute(size_t localWorkSize, const EventList& waitList)
 {
+    if (mImplementation == BITSLICED)
+        throw std::invalid_argument("AES GCM has no bitsliced implementation.");
+
     if (!mExpandedKey)
         throw std::runtime_error("Key has not been set.");
 
-    if (!mPlainText)
+    if (!mTexts.getInput())
         throw std::runtime_error("Plaintext has not been set.");
 
-    if (!mCipherText)
+    if (!mTexts.getOutput())
         throw std::runtime_error("CipherText buffer has not been allocated! This is most likely a bug.");
 
-    Program& program = mSystem.getProgramFromCache(mDevice, ProgramSources::AES);
-    const cl_uint rounds = mRounds;
-
-    const cl_uint plainTextSize = mPlainText->getArraySize<unsigned char>();
+    const size_t plainTextSize = mTexts.getInput()->getArraySize<unsigned char>();
     assert(plainTextSize % 16 == 0);
-    const cl_uint blockCount = plainTextSize / 16;
+    const size_t blockCount = plainTextSize / 16;
+
+    // follow the queue of the cipher in case it has been changed
+    mTexts.setQueueIndex(mQueueIndex);
 
-    ScopedKernel kernel(program.createKernel("AES_GCM_Encrypt"));
+    Kernel& kernel = prepareKernel("AES_GCM_Encrypt", 1, 4);
 
-    kernel->setParameter(0, *mPlainText);
-    kernel->setParameter(1, *mExpandedKey);
-    kernel->setParameter(2, &mIV);
-    kernel->setParameter(3, *mCipherText);
-    kernel->setParameter(4, &rounds);
+    kernel.setParameter(0, *mTexts.getInput());
+    kernel.setParameter(2, &mIV);
+    kernel.setParameter(3, *mTexts.getOutput());
 
-    kernel->execute(blockCount, localWorkSize, false);
+    return kernel.executeBounded(blockCount, localWorkSize, 5, false, waitList, getBlocksPerWorkItem());
 }
 
 }
@@ -26,6 +26,13 @@
 #include "oclcrypto/BLOWFISH_Base.h"
 #include "oclcrypto/Device.h"
 #include "oclcrypto/DataBuffer.h"
+#include "oclcrypto/System.h"
+#include "oclcrypto/Program.h"
+#include "oclcrypto/Kernel.h"
+
+#include <algorithm>
+#include <cassert>
+#include <string>
 
 namespace oclcrypto
 {
@@ -397,15 +404,23 @@ void BLOWFISH_Base::generatePAndSBoxes(const unsigned char* key, size_t keySize,
 BLOWFISH_Base::BLOWFISH_Base(System& system, Device& device):
     mSystem(system),
     mDevice(device),
+    mQueueIndex(device.acquireQueue()),
 
     mP(nullptr),
-    mSBoxes(nullptr)
+    mSBoxes(nullptr),
+
+    mKernel(nullptr),
+    mKernelKeyBound(false),
+    mKernelBlocksPerWorkItem(1)
 {}
 
 BLOWFISH_Base::~BLOWFISH_Base()
 {
     try
     {
+        if (mKernel)
+            mKernel->getProgram().destroyKernel(*mKernel);
+
         if (mP)
             mDevice.deallocateBuffer(*mP);
 
@@ -431,22 +446,72 @@ void BLOWFISH_Base::setKey(const unsigned char* key, size_t size)
     generatePAndSBoxes(key, size, p, sboxes);
 
     if (!mP)
+    {
         mP = &mDevice.allocateBuffer<uint32_t>(18, DataBuffer::Read);
+        mP->setQueueIndex(mQueueIndex);
+        mKernelKeyBound = false;
+    }
 
     if (!mSBoxes)
+    {
         mSBoxes = &mDevice.allocateBuffer<uint32_t>(4 * 256, DataBuffer::Read);
+        mSBoxes->setQueueIndex(mQueueIndex);
+        mKernelKeyBound = false;
+    }
 
     {
-        auto data = mP->lockWrite<uint32_t>();
-        for (size_t i = 0; i < 18; ++i)
-            data[i] = p[i];
+        auto data = mP->lockOverwrite<uint32_t>();
+        std::copy(p, p + 18, data.begin());
     }
 
     {
-        auto data = mSBoxes->lockWrite<uint32_t>();
-        for (size_t i = 0; i < 4 * 256; ++i)
-            data[i] = sboxes[i];
+        auto data = mSBoxes->lockOverwrite<uint32_t>();
+        std::copy(sboxes, sboxes + 4 * 256, data.begin());
     }
 }
 
+void BLOWFISH_Base::setQueueIndex(size_t idx)
+{
+    mQueueIndex = idx;
+}
+
+Kernel& BLOWFISH_Base::prepareKernel(const char* name, cl_uint pIndex, cl_uint sboxesIndex)
+{
+    const size_t blocksPerWorkItem = mDevice.getBlocksPerWorkItem();
+
+    if (mKernel && mKernelBlocksPerWorkItem != blocksPerWorkItem)
+    {
+        // the kernel comes from a program built for another number of blocks per work-item
+        mKernel->getProgram().destroyKernel(*mKernel);
+        mKernel = nullptr;
+    }
+
+    if (!mKernel)
+    {
+        // explicitly, the device may change its number while we build
+        ProgramSources::Defines defines;
+        defines["BLOCKS_PER_ITEM"] = std::to_string(blocksPerWorkItem);
+
+        Program& program = mSystem.getProgramFromCache(mDevice, ProgramSources::BLOWFISH, defines);
+        mKernel = &program.createKernel(name);
+        mKernelBlocksPerWorkItem = blocksPerWorkItem;
+        mKernelKeyBound = false;
+    }
+
+    assert(mKernel->getName() == name);
+
+    mKernel->setQueueIndex(mQueueIndex);
+    mP->setQueueIndex(mQueueIndex);
+    mSBoxes->setQueueIndex(mQueueIndex);
+
+    if (!mKernelKeyBound)
+    {
+        mKernel->setParameter(pIndex, *mP);
+        mKernel->setParameter(sboxesIndex, *mSBoxes);
+        mKernelKeyBound = true;
+    }
+
+    return *mKernel;
+}
+
 }
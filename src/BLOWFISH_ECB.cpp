@@ -30,6 +30,7 @@
 #include "oclcrypto/Kernel.h"
 #include "oclcrypto/System.h"
 
+#include <algorithm>
 #include <cassert>
 #include <string>
 
@@ -39,87 +40,57 @@ namespace oclcrypto
 BLOWFISH_ECB_Encrypt::BLOWFISH_ECB_Encrypt(System& system, Device& device):
     BLOWFISH_Base(system, device),
 
-    mPlainText(nullptr),
-    mCipherText(nullptr)
+    mTexts(device, 8, "BLOWFISH", false)
 {}
 
 BLOWFISH_ECB_Encrypt::~BLOWFISH_ECB_Encrypt()
-{
-    try
-    {
-        if (mPlainText)
-            mDevice.deallocateBuffer(*mPlainText);
-
-        if (mCipherText)
-            mDevice.deallocateBuffer(*mCipherText);
-    }
-    catch (...)
-    {
-        // TODO: log?
-    }
-}
+{}
 
 void BLOWFISH_ECB_Encrypt::setPlainText(const unsigned char* plaintext, size_t size)
 {
-    if (plaintext == nullptr)
-        throw std::invalid_argument("Non-null plaintext is required");
-
-    if (size == 0)
-        throw std::invalid_argument("Make sure plaintext size greater than 0");
-
-    if (size % 8 != 0)
-        throw std::invalid_argument("Plaintext has to be padded to make full BLOWFISH blocks. "
-                                    "Its size has to be a multiple of 8.");
-
-    if (!mPlainText || mPlainText->getArraySize<unsigned char>() != size)
-    {
-        if (mPlainText)
-            mDevice.deallocateBuffer(*mPlainText);
-
-        mPlainText = &mDevice.allocateBuffer<unsigned char>(size, DataBuffer::Read);
-    }
+    mTexts.setInput(plaintext, size, mQueueIndex);
+}
 
-    {
-        auto data = mPlainText->lockWrite<unsigned char>();
-        for (size_t i = 0; i < size; ++i)
-            data[i] = plaintext[i];
-    }
+bool BLOWFISH_ECB_Encrypt::wrapPlainText(const unsigned char* plaintext, size_t size)
+{
+    return mTexts.wrapInput(plaintext, size, mQueueIndex);
+}
 
-    if (!mCipherText || mCipherText->getArraySize<unsigned char>() != size)
-    {
-        if (mCipherText)
-            mDevice.deallocateBuffer(*mCipherText);
+void BLOWFISH_ECB_Encrypt::setPlainTextView(DataBuffer& buffer, size_t offset, size_t size)
+{
+    mTexts.setInputView(buffer, offset, size, mQueueIndex);
+}
 
-        mCipherText = &mDevice.allocateBuffer<unsigned char>(size, DataBuffer::Write);
-    }
+void BLOWFISH_ECB_Encrypt::setInPlace(bool inPlace)
+{
+    mTexts.setInPlace(inPlace);
 }
 
-void BLOWFISH_ECB_Encrypt::execute(size_t localWorkSize)
+Event BLOWFISH_ECB_Encrypt::execute(size_t localWorkSize, const EventList& waitList)
 {
     if (!mP || !mSBoxes)
         throw std::runtime_error("Key has not been set.");
 
-    if (!mPlainText)
+    if (!mTexts.getInput())
         throw std::runtime_error("Plaintext has not been set.");
 
-    if (!mCipherText)
+    if (!mTexts.getOutput())
         throw std::runtime_error("CipherText buffer has not been allocated! This is most likely a bug.");
 
-    Program& program = mSystem.getProgramFromCache(mDevice, ProgramSources::BLOWFISH);
-
-    const cl_uint plainTextSize = mPlainText->getArraySize<unsigned char>();
+    const size_t plainTextSize = mTexts.getInput()->getArraySize<unsigned char>();
     assert(plainTextSize % 8 == 0);
-    const cl_uint blockCount = plainTextSize / 8;
+    const size_t blockCount = plainTextSize / 8;
+
+    // follow the queue of the cipher in case it has been changed
+    mTexts.setQueueIndex(mQueueIndex);
 
-    ScopedKernel kernel(program.createKernel("BLOWFISH_ECB_Encrypt"));
+    Kernel& kernel = prepareKernel("BLOWFISH_ECB_Encrypt", 1, 2);
 
-    kernel->setParameter(0, *mPlainText);
-    kernel->setParameter(1, *mP);
-    kernel->setParameter(2, *mSBoxes);
-    kernel->setParameter(3, *mCipherText);
-    //kernel->allocateLocalParameter<cl_uchar16>(4, localWorkSize);
+    kernel.setParameter(0, *mTexts.getInput());
+    kernel.setParameter(3, *mTexts.getOutput());
+    //kernel.allocateLocalParameter<cl_uchar16>(4, localWorkSize);
 
-    kernel->execute(blockCount, localWorkSize, false);
+    return kernel.executeBounded(blockCount, localWorkSize, 4, false, waitList, getBlocksPerWorkItem());
 }
 
 }
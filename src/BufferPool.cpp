@@ -0,0 +1,193 @@
+/*
+ * Copyright (C) 2015 Martin Preisler <martin@preisler.me>
+ *
+ * This file is part of oclcrypto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "oclcrypto/BufferPool.h"
+#include "oclcrypto/CLError.h"
+#include "oclcrypto/Device.h"
+
+#include <algorithm>
+
+namespace oclcrypto
+{
+
+const size_t BufferPool::MinimumSizeClass;
+const size_t BufferPool::DefaultHighWaterMark;
+
+BufferPool::BufferPool(Device& device):
+    mDevice(device),
+
+    mHighWaterMark(DefaultHighWaterMark),
+    mCachedBytes(0),
+    mDriverAllocationCount(0)
+{}
+
+BufferPool::~BufferPool()
+{
+    try
+    {
+        trim(0);
+    }
+    catch (...)
+    {
+        // TODO: log
+    }
+}
+
+cl_mem BufferPool::acquire(size_t size, cl_mem_flags flags, size_t& capacity)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    capacity = getSizeClassLocked(size);
+
+    PoolMap::iterator it = mPool.find(PoolKey(capacity, flags));
+    if (it != mPool.end() && !it->second.empty())
+    {
+        cl_mem ret = it->second.back();
+        it->second.pop_back();
+        mCachedBytes -= capacity;
+        return ret;
+    }
+
+    cl_int err;
+    cl_mem ret = clCreateBuffer(mDevice.getCLContext(), flags, capacity, nullptr, &err);
+    if (err == CL_MEM_OBJECT_ALLOCATION_FAILURE || err == CL_OUT_OF_RESOURCES)
+    {
+        // the driver might just be out of memory because we hold too much of it
+        trimLocked(0);
+        ret = clCreateBuffer(mDevice.getCLContext(), flags, capacity, nullptr, &err);
+    }
+    CLErrorGuard(err);
+
+    ++mDriverAllocationCount;
+    return ret;
+}
+
+void BufferPool::release(cl_mem mem, size_t capacity, cl_mem_flags flags)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    if (mCachedBytes + capacity > mHighWaterMark)
+    {
+        CLErrorGuard(clReleaseMemObject(mem));
+        return;
+    }
+
+    mPool[PoolKey(capacity, flags)].push_back(mem);
+    mCachedBytes += capacity;
+}
+
+void BufferPool::trim(size_t targetBytes)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    trimLocked(targetBytes);
+}
+
+void BufferPool::setHighWaterMark(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mHighWaterMark = bytes;
+    trimLocked(bytes);
+}
+
+size_t BufferPool::getHighWaterMark() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mHighWaterMark;
+}
+
+void BufferPool::setSizeClasses(const std::vector<size_t>& sizeClasses)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    mSizeClasses = sizeClasses;
+    std::sort(mSizeClasses.begin(), mSizeClasses.end());
+
+    // memory objects of the old classes would most likely never be reused
+    trimLocked(0);
+}
+
+size_t BufferPool::getSizeClass(size_t size) const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return getSizeClassLocked(size);
+}
+
+size_t BufferPool::getSizeClassLocked(size_t size) const
+{
+    if (!mSizeClasses.empty())
+    {
+        std::vector<size_t>::const_iterator it =
+            std::lower_bound(mSizeClasses.begin(), mSizeClasses.end(), size);
+
+        return it != mSizeClasses.end() ? *it : size;
+    }
+
+    size_t ret = MinimumSizeClass;
+    while (ret < size)
+    {
+        // we would overflow, use the exact size instead
+        if (ret > (~static_cast<size_t>(0)) / 2)
+            return size;
+
+        ret *= 2;
+    }
+
+    // rounding up must not turn a valid request into one the device can't satisfy
+    if (ret > mDevice.getMaxMemAllocSize())
+        return size;
+
+    return ret;
+}
+
+size_t BufferPool::getCachedBytes() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mCachedBytes;
+}
+
+size_t BufferPool::getDriverAllocationCount() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mDriverAllocationCount;
+}
+
+void BufferPool::trimLocked(size_t targetBytes)
+{
+    // release the biggest size classes first, they are the least likely to be reused
+    for (PoolMap::reverse_iterator it = mPool.rbegin();
+         it != mPool.rend() && mCachedBytes > targetBytes; ++it)
+    {
+        std::vector<cl_mem>& mems = it->second;
+        while (!mems.empty() && mCachedBytes > targetBytes)
+        {
+            cl_mem mem = mems.back();
+            mems.pop_back();
+            mCachedBytes -= it->first.first;
+            CLErrorGuard(clReleaseMemObject(mem));
+        }
+    }
+}
+
+}
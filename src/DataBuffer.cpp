@@ -31,9 +31,23 @@ namespace oclcrypto
 {
 
 DataBuffer::DataBuffer(Device& device, const size_t size, const unsigned short memFlags):
+    DataBuffer(device, size, memFlags, nullptr)
+{}
+
+DataBuffer::DataBuffer(Device& device, const size_t size, const unsigned short memFlags, void* hostPtr):
     mDevice(device),
     mSize(size),
-    mMemFlags(memFlags)
+    mMemFlags(memFlags),
+    mHostPtr(hostPtr),
+
+    mParent(nullptr),
+    mViewOffset(0),
+    mViewCount(0),
+
+    mQueueIndex(0),
+    mQueueUsed(false),
+
+    mCapacity(size)
 {
     cl_mem_flags clMemFlags = 0;
     switch (memFlags)
@@ -53,18 +67,87 @@ DataBuffer::DataBuffer(Device& device, const size_t size, const unsigned short m
             break;
     }
 
-    clMemFlags |= CL_MEM_ALLOC_HOST_PTR;
+    if (hostPtr)
+    {
+        // the caller gives us memory to use directly, this can't be pooled
+        mCLMemFlags = clMemFlags | CL_MEM_USE_HOST_PTR;
+
+        cl_int err;
+        mCLMem = clCreateBuffer(device.getCLContext(), mCLMemFlags, size, hostPtr, &err);
+        CLErrorGuard(err);
+    }
+    else
+    {
+        // we let the implementation allocate host accessible memory for fast mapping
+        mCLMemFlags = clMemFlags | CL_MEM_ALLOC_HOST_PTR;
+        mCLMem = device.getBufferPool().acquire(size, mCLMemFlags, mCapacity);
+    }
+}
+
+DataBuffer::DataBuffer(DataBuffer& parent, const size_t offset, const size_t size):
+    mDevice(parent.getDevice()),
+    mSize(size),
+    mMemFlags(parent.mMemFlags),
+    mHostPtr(parent.mHostPtr ? static_cast<char*>(parent.mHostPtr) + offset : nullptr),
+
+    mParent(&parent),
+    mViewOffset(offset),
+    mViewCount(0),
+
+    mQueueIndex(parent.mQueueIndex),
+    mQueueUsed(false),
+
+    mCapacity(size),
+    // sub-buffers inherit access flags of their parent and can't have host pointer flags
+    mCLMemFlags(0)
+{
+    if (parent.isView())
+        throw std::invalid_argument("Views have to be created directly from the parent buffer.");
+
+    if (size == 0)
+        throw std::invalid_argument("Can't create an empty view.");
+
+    if (offset > parent.getSize() || size > parent.getSize() - offset)
+        throw std::out_of_range("View range exceeds the size of the parent DataBuffer.");
+
+    if (offset % mDevice.getMemBaseAddrAlign() != 0)
+        throw std::invalid_argument(
+            "View offset " + std::to_string(offset) + " has to be a multiple of " +
+            std::to_string(mDevice.getMemBaseAddrAlign()) + " (CL_DEVICE_MEM_BASE_ADDR_ALIGN).");
+
+    cl_buffer_region region;
+    region.origin = offset;
+    region.size = size;
 
     cl_int err;
-    mCLMem = clCreateBuffer(device.getCLContext(), clMemFlags, size, nullptr, &err);
+    mCLMem = clCreateSubBuffer(parent.mCLMem, mCLMemFlags, CL_BUFFER_CREATE_TYPE_REGION, &region, &err);
     CLErrorGuard(err);
+
+    ++parent.mViewCount;
 }
 
 DataBuffer::~DataBuffer()
 {
     try
     {
-        CLErrorGuard(clReleaseMemObject(mCLMem));
+        if (mParent)
+        {
+            // views never come from the pool, the parent owns the memory,
+            // Device::deallocateBuffer has already decreased its view count
+            CLErrorGuard(clReleaseMemObject(mCLMem));
+        }
+        else if (mHostPtr)
+            CLErrorGuard(clReleaseMemObject(mCLMem));
+        else
+        {
+            // the next owner of the pooled memory may use a different queue,
+            // commands still using it on ours have to finish first, views
+            // have recorded theirs here as well
+            if (mDevice.getQueueCount() > 1)
+                waitForLastEvents();
+
+            mDevice.getBufferPool().release(mCLMem, mCapacity, mCLMemFlags);
+        }
     }
     catch (...)
     {
@@ -77,6 +160,20 @@ Device& DataBuffer::getDevice() const
     return mDevice;
 }
 
+DataBuffer& DataBuffer::createView(const size_t offset, const size_t size)
+{
+    if (mParent)
+    {
+        // OpenCL doesn't allow sub-buffers of sub-buffers
+        if (offset > mSize || size > mSize - offset)
+            throw std::out_of_range("View range exceeds the size of the parent DataBuffer.");
+
+        return mDevice.createBufferView(*mParent, mViewOffset + offset, size);
+    }
+
+    return mDevice.createBufferView(*this, offset, size);
+}
+
 cl_mem DataBuffer::getCLMem() const
 {
     return mCLMem;
@@ -87,30 +184,224 @@ const cl_mem* DataBuffer::getCLMemPtr() const
     return &mCLMem;
 }
 
+void DataBuffer::setQueueIndex(size_t idx)
+{
+    if (idx == mQueueIndex)
+        return;
+
+    // a fresh view still has to wait for what its parent has enqueued
+    const bool used = mQueueUsed || (mParent && mParent->mQueueUsed);
+
+    if (used && mDevice.getCLQueue(mQueueIndex) != mDevice.getCLQueue(idx))
+    {
+        // keep the commands already enqueued ordered before the ones on the new queue
+        mDevice.finishQueue(mQueueIndex);
+        mQueueUsed = false;
+    }
+
+    mQueueIndex = idx;
+}
+
 void* DataBuffer::mapForReading()
 {
-    cl_int err;
-    void* ret = clEnqueueMapBuffer(mDevice.getCLQueue(), mCLMem, CL_TRUE, CL_MAP_READ, 0, getSize(), 0, nullptr, nullptr, &err);
-    CLErrorGuard(err);
-    return ret;
+    return mapForReading(0, getSize());
 }
 
 void DataBuffer::unmapForReading(void* buffer)
 {
-    CLErrorGuard(clEnqueueUnmapMemObject(mDevice.getCLQueue(), mCLMem, buffer, 0, nullptr, nullptr));
+    unmap(buffer, nullptr);
 }
 
 void* DataBuffer::mapForWriting()
 {
+    return mapForWriting(0, getSize());
+}
+
+void DataBuffer::unmapForWriting(void* buffer)
+{
+    unmap(buffer, nullptr);
+}
+
+void* DataBuffer::mapForReading(size_t offset, size_t size)
+{
+    return map(CL_MAP_READ, offset, size, true, nullptr);
+}
+
+void* DataBuffer::mapForWriting(size_t offset, size_t size)
+{
+    return map(CL_MAP_WRITE, offset, size, true, nullptr);
+}
+
+void* DataBuffer::mapForOverwriting(size_t offset, size_t size)
+{
+    return map(getOverwriteMapFlags(), offset, size, true, nullptr);
+}
+
+void* DataBuffer::mapForOverwriting()
+{
+    return mapForOverwriting(0, getSize());
+}
+
+void* DataBuffer::mapForReadingAsync(Event& event, const EventList& waitList)
+{
+    return mapForReadingAsync(0, getSize(), event, waitList);
+}
+
+void* DataBuffer::mapForReadingAsync(size_t offset, size_t size, Event& event, const EventList& waitList)
+{
+    cl_event clEvent;
+    void* ret = map(CL_MAP_READ, offset, size, false, &clEvent, waitList);
+    event = Event(clEvent);
+    return ret;
+}
+
+void* DataBuffer::mapForWritingAsync(Event& event, const EventList& waitList)
+{
+    return mapForWritingAsync(0, getSize(), event, waitList);
+}
+
+void* DataBuffer::mapForWritingAsync(size_t offset, size_t size, Event& event, const EventList& waitList)
+{
+    cl_event clEvent;
+    void* ret = map(CL_MAP_WRITE, offset, size, false, &clEvent, waitList);
+    event = Event(clEvent);
+    return ret;
+}
+
+void* DataBuffer::mapForOverwritingAsync(size_t offset, size_t size, Event& event, const EventList& waitList)
+{
+    cl_event clEvent;
+    void* ret = map(getOverwriteMapFlags(), offset, size, false, &clEvent, waitList);
+    event = Event(clEvent);
+    return ret;
+}
+
+void DataBuffer::unmapAsync(void* buffer, Event& event, const EventList& waitList)
+{
+    cl_event clEvent;
+    unmap(buffer, &clEvent, waitList);
+    event = Event(clEvent);
+}
+
+void DataBuffer::write(const void* data, size_t size, size_t offset)
+{
+    checkRange(offset, size);
+    CLErrorGuard(clEnqueueWriteBuffer(getCLQueue(), mCLMem, CL_TRUE, offset, size, data, 0, nullptr, nullptr));
+}
+
+void DataBuffer::read(void* data, size_t size, size_t offset)
+{
+    checkRange(offset, size);
+    CLErrorGuard(clEnqueueReadBuffer(getCLQueue(), mCLMem, CL_TRUE, offset, size, data, 0, nullptr, nullptr));
+}
+
+void DataBuffer::writeAsync(const void* data, size_t size, size_t offset, Event& event, const EventList& waitList)
+{
+    checkRange(offset, size);
+    const std::vector<cl_event> clWaitList = Event::getCLEvents(waitList);
+
+    cl_event clEvent;
+    CLErrorGuard(clEnqueueWriteBuffer(getCLQueue(), mCLMem, CL_FALSE, offset, size, data,
+        clWaitList.size(), clWaitList.empty() ? nullptr : clWaitList.data(), &clEvent));
+    event = Event(clEvent);
+    recordLastEvent(clEvent);
+}
+
+void DataBuffer::readAsync(void* data, size_t size, size_t offset, Event& event, const EventList& waitList)
+{
+    checkRange(offset, size);
+    const std::vector<cl_event> clWaitList = Event::getCLEvents(waitList);
+
+    cl_event clEvent;
+    CLErrorGuard(clEnqueueReadBuffer(getCLQueue(), mCLMem, CL_FALSE, offset, size, data,
+        clWaitList.size(), clWaitList.empty() ? nullptr : clWaitList.data(), &clEvent));
+    event = Event(clEvent);
+    recordLastEvent(clEvent);
+}
+
+void* DataBuffer::map(cl_map_flags flags, size_t offset, size_t size, bool blocking, cl_event* event,
+                      const EventList& waitList)
+{
+    checkRange(offset, size);
+    const std::vector<cl_event> clWaitList = Event::getCLEvents(waitList);
+
     cl_int err;
-    void* ret = clEnqueueMapBuffer(mDevice.getCLQueue(), mCLMem, CL_TRUE, CL_MAP_WRITE, 0, getSize(), 0, nullptr, nullptr, &err);
+    void* ret = clEnqueueMapBuffer(getCLQueue(), mCLMem, blocking ? CL_TRUE : CL_FALSE, flags, offset, size,
+        clWaitList.size(), clWaitList.empty() ? nullptr : clWaitList.data(), event, &err);
     CLErrorGuard(err);
+
+    // blocking maps have completed already
+    if (event)
+        recordLastEvent(*event);
+
     return ret;
 }
 
-void DataBuffer::unmapForWriting(void* buffer)
+void DataBuffer::unmap(void* buffer, cl_event* event, const EventList& waitList)
+{
+    const std::vector<cl_event> clWaitList = Event::getCLEvents(waitList);
+
+    // unmapping never blocks, we need its event even if the caller doesn't
+    cl_event clEvent;
+    CLErrorGuard(clEnqueueUnmapMemObject(getCLQueue(), mCLMem, buffer,
+        clWaitList.size(), clWaitList.empty() ? nullptr : clWaitList.data(), &clEvent));
+
+    const Event unmapEvent(clEvent);
+    recordLastEvent(clEvent);
+
+    if (event)
+    {
+        CLErrorGuard(clRetainEvent(clEvent));
+        *event = clEvent;
+    }
+}
+
+cl_command_queue DataBuffer::getCLQueue()
+{
+    mQueueUsed = true;
+    return mDevice.getCLQueue(mQueueIndex);
+}
+
+void DataBuffer::recordLastEvent(cl_event event)
 {
-    CLErrorGuard(clEnqueueUnmapMemObject(mDevice.getCLQueue(), mCLMem, buffer, 0, nullptr, nullptr));
+    CLErrorGuard(clRetainEvent(event));
+    const Event lastEvent(event);
+
+    DataBuffer& owner = mParent ? *mParent : *this;
+    std::lock_guard<std::mutex> lock(owner.mLastEventsMutex);
+    owner.mLastEvents[mQueueIndex] = lastEvent;
+}
+
+void DataBuffer::waitForLastEvents()
+{
+    std::map<size_t, Event> lastEvents;
+    {
+        std::lock_guard<std::mutex> lock(mLastEventsMutex);
+        lastEvents.swap(mLastEvents);
+    }
+
+    for (std::map<size_t, Event>::const_iterator it = lastEvents.begin(); it != lastEvents.end(); ++it)
+        it->second.wait();
+}
+
+void DataBuffer::checkRange(size_t offset, size_t size) const
+{
+    if (size == 0)
+        throw std::invalid_argument("Can't access an empty range of a DataBuffer.");
+
+    if (offset > getSize() || size > getSize() - offset)
+        throw std::out_of_range("Accessed range exceeds the size of the DataBuffer.");
+}
+
+cl_map_flags DataBuffer::getOverwriteMapFlags() const
+{
+#ifdef CL_VERSION_1_2
+    // the headers may be newer than the device, only 1.2 devices understand the flag
+    if (mDevice.supportsCLVersion(1, 2))
+        return CL_MAP_WRITE_INVALIDATE_REGION;
+#endif
+
+    return CL_MAP_WRITE;
 }
 
 }
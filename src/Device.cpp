@@ -28,13 +28,39 @@
 #include "oclcrypto/Program.h"
 
 #include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <cstdio>
 
 namespace oclcrypto
 {
 
+const size_t Device::MaxBlocksPerWorkItem;
+
+DeviceMemoryBudgetExceeded::DeviceMemoryBudgetExceeded(const std::string& message, size_t requestedBytes, size_t availableBytes):
+    std::runtime_error(
+        message + " Requested " + std::to_string(requestedBytes) + " bytes, " +
+        std::to_string(availableBytes) + " bytes available."
+    ),
+
+    mRequestedBytes(requestedBytes),
+    mAvailableBytes(availableBytes)
+{}
+
 Device::Device(cl_platform_id platformID, cl_device_id deviceID):
     mCLPlatformID(platformID),
-    mCLDeviceID(deviceID)
+    mCLDeviceID(deviceID),
+    mNextQueue(0),
+    mProfilingEnabled(false),
+
+    mBufferPool(*this),
+
+    mCapacity(0),
+    mBlocksPerWorkItem(1),
+
+    mLiveBytes(0),
+    mPeakBytes(0),
+    mAllocationCount(0)
 {
     cl_context_properties contextProperties[] = {
         CL_CONTEXT_PLATFORM, reinterpret_cast<cl_context_properties>(mCLPlatformID),
@@ -45,9 +71,30 @@ Device::Device(cl_platform_id platformID, cl_device_id deviceID):
 
     mCLContext = clCreateContext(contextProperties, 1, &mCLDeviceID, nullptr, nullptr, &err);
     CLErrorGuard(err);
-    // TODO: command_queue_properties might be useful for profiling
-    mCLQueue = clCreateCommandQueue(mCLContext, mCLDeviceID, 0, &err);
-    CLErrorGuard(err);
+    createQueues(1, false);
+
+    cl_uint memBaseAddrAlign = 0; // in bits
+    CLErrorGuard(clGetDeviceInfo(mCLDeviceID, CL_DEVICE_MEM_BASE_ADDR_ALIGN, sizeof(memBaseAddrAlign), &memBaseAddrAlign, nullptr));
+    mMemBaseAddrAlign = std::max<size_t>(memBaseAddrAlign / 8, 1);
+
+    // the format is mandated by the spec: "OpenCL<space><major.minor><space><vendor-specific information>"
+    mCLVersionMajor = 1;
+    mCLVersionMinor = 0;
+    std::sscanf(getVersion().c_str(), "OpenCL %u.%u", &mCLVersionMajor, &mCLVersionMinor);
+
+    cl_ulong globalMemSize = 0;
+    CLErrorGuard(clGetDeviceInfo(mCLDeviceID, CL_DEVICE_GLOBAL_MEM_SIZE, sizeof(globalMemSize), &globalMemSize, nullptr));
+    cl_ulong maxMemAllocSize = 0;
+    CLErrorGuard(clGetDeviceInfo(mCLDeviceID, CL_DEVICE_MAX_MEM_ALLOC_SIZE, sizeof(maxMemAllocSize), &maxMemAllocSize, nullptr));
+    // cl_ulong may not fit size_t on 32bit hosts
+    mGlobalMemSize = static_cast<size_t>(std::min<cl_ulong>(globalMemSize, SIZE_MAX));
+    mMaxMemAllocSize = static_cast<size_t>(std::min<cl_ulong>(maxMemAllocSize, SIZE_MAX));
+    mMemoryBudget = mGlobalMemSize;
+
+    mCapacity = estimateCapacity();
+    // CPU implementations run the work-items of a group as a loop, each one
+    // costs more there than on a GPU which would rather have many of them
+    mBlocksPerWorkItem = (getType() & CL_DEVICE_TYPE_CPU) ? 8 : 2;
 }
 
 Device::~Device()
@@ -70,7 +117,10 @@ Device::~Device()
 
     try
     {
-        CLErrorGuard(clReleaseCommandQueue(mCLQueue));
+        // memory objects have to go before the context they belong to
+        mBufferPool.trim(0);
+
+        releaseQueues();
         CLErrorGuard(clReleaseContext(mCLContext));
 
         // We shall not call clReleaseDevice here, clReleaseDevice releases subdevices,
@@ -83,6 +133,84 @@ Device::~Device()
     }
 }
 
+void Device::setQueueCount(size_t count)
+{
+    if (count == 0)
+        throw std::invalid_argument("A Device needs at least one command queue.");
+
+    if (count == mCLQueues.size())
+        return;
+
+    createQueues(count, mProfilingEnabled);
+}
+
+size_t Device::acquireQueue()
+{
+    return mNextQueue++ % mCLQueues.size();
+}
+
+void Device::finishQueue(size_t idx)
+{
+    CLErrorGuard(clFinish(getCLQueue(idx)));
+}
+
+void Device::setProfilingEnabled(bool enabled)
+{
+    if (enabled == mProfilingEnabled)
+        return;
+
+    createQueues(mCLQueues.size(), enabled);
+}
+
+void Device::createQueues(size_t count, bool profilingEnabled)
+{
+    for (std::vector<cl_command_queue>::const_iterator it = mCLQueues.begin();
+         it != mCLQueues.end(); ++it)
+    {
+        CLErrorGuard(clFinish(*it));
+    }
+
+    std::vector<cl_command_queue> queues;
+    try
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            cl_int err;
+            queues.push_back(clCreateCommandQueue(
+                mCLContext, mCLDeviceID, profilingEnabled ? CL_QUEUE_PROFILING_ENABLE : 0, &err));
+            CLErrorGuard(err);
+        }
+    }
+    catch (...)
+    {
+        for (std::vector<cl_command_queue>::const_iterator it = queues.begin();
+             it != queues.end(); ++it)
+        {
+            if (*it)
+                clReleaseCommandQueue(*it);
+        }
+
+        throw;
+    }
+
+    // events of the old queues stay valid, they hold their own reference
+    releaseQueues();
+
+    mCLQueues.swap(queues);
+    mProfilingEnabled = profilingEnabled;
+}
+
+void Device::releaseQueues()
+{
+    for (std::vector<cl_command_queue>::const_iterator it = mCLQueues.begin();
+         it != mCLQueues.end(); ++it)
+    {
+        CLErrorGuard(clReleaseCommandQueue(*it));
+    }
+
+    mCLQueues.clear();
+}
+
 std::string Device::getName() const
 {
     char buffer[256];
@@ -91,6 +219,20 @@ std::string Device::getName() const
     return std::string(buffer, retSize);
 }
 
+std::string Device::getVersion() const
+{
+    char buffer[256] = {0};
+    CLErrorGuard(clGetDeviceInfo(mCLDeviceID, CL_DEVICE_VERSION, sizeof(buffer) - 1, buffer, nullptr));
+    return std::string(buffer);
+}
+
+std::string Device::getDriverVersion() const
+{
+    char buffer[256] = {0};
+    CLErrorGuard(clGetDeviceInfo(mCLDeviceID, CL_DRIVER_VERSION, sizeof(buffer) - 1, buffer, nullptr));
+    return std::string(buffer);
+}
+
 Endianess Device::getEndianess() const
 {
     cl_bool ret = CL_FALSE;
@@ -98,15 +240,19 @@ Endianess Device::getEndianess() const
     return ret == CL_TRUE ? E_LITTLE_ENDIAN : E_BIG_ENDIAN;
 }
 
-Program& Device::createProgram(const std::string& source)
+Program& Device::createProgram(const std::string& source, ProgramBinaryCache* binaryCache,
+                               const std::string& extraBuildOptions)
 {
-    Program* ret = new Program(*this, source);
+    Program* ret = new Program(*this, source, binaryCache, extraBuildOptions);
+
+    std::lock_guard<std::mutex> lock(mProgramsMutex);
     mPrograms.push_back(ret);
     return *ret;
 }
 
 void Device::destroyProgram(Program& program)
 {
+    std::lock_guard<std::mutex> lock(mProgramsMutex);
     ProgramVector::iterator it = std::find(mPrograms.begin(), mPrograms.end(), &program);
 
     if (it == mPrograms.end())
@@ -121,35 +267,255 @@ void Device::destroyProgram(Program& program)
 
 DataBuffer& Device::allocateBufferRaw(const size_t size, const unsigned short memFlags)
 {
-    DataBuffer* ret = new DataBuffer(*this, size, memFlags);
+    const size_t reservedSize = mBufferPool.getSizeClass(size);
+    reserveMemory(reservedSize);
+
+    DataBuffer* ret;
+    try
+    {
+        ret = new DataBuffer(*this, size, memFlags);
+    }
+    catch (...)
+    {
+        releaseMemory(reservedSize);
+        throw;
+    }
+
+    registerBuffer(ret, reservedSize);
+    return *ret;
+}
+
+DataBuffer& Device::wrapHostMemory(void* hostPtr, const size_t size, const unsigned short memFlags)
+{
+    if (hostPtr == nullptr)
+        throw std::invalid_argument("Non-null host memory is required to wrap it.");
+
+    reserveMemory(size);
+
+    DataBuffer* ret;
+    try
+    {
+        ret = new DataBuffer(*this, size, memFlags, hostPtr);
+    }
+    catch (...)
+    {
+        releaseMemory(size);
+        throw;
+    }
+
+    registerBuffer(ret, size);
+    return *ret;
+}
+
+DataBuffer& Device::createBufferView(DataBuffer& parent, const size_t offset, const size_t size)
+{
+    if (&parent.getDevice() != this)
+        throw std::invalid_argument("Given DataBuffer belongs to another Device.");
+
+    // the view changes the view count of its parent, deallocateBuffer checks that
+    std::lock_guard<std::mutex> lock(mDataBuffersMutex);
+
+    DataBuffer* ret = new DataBuffer(parent, offset, size);
     mDataBuffers.push_back(ret);
     return *ret;
 }
 
 void Device::deallocateBuffer(DataBuffer& buffer)
 {
-    DataBufferVector::iterator it = std::find(mDataBuffers.begin(), mDataBuffers.end(), &buffer);
+    {
+        std::lock_guard<std::mutex> lock(mDataBuffersMutex);
 
-    if (it == mDataBuffers.end())
-        throw std::invalid_argument(
-            "Given DataBuffer has already been destroyed by this Device or "
-            "it belongs to another Device."
-        );
+        DataBufferVector::iterator it = std::find(mDataBuffers.begin(), mDataBuffers.end(), &buffer);
+
+        if (it == mDataBuffers.end())
+            throw std::invalid_argument(
+                "Given DataBuffer has already been destroyed by this Device or "
+                "it belongs to another Device."
+            );
+
+        if (buffer.getViewCount() > 0)
+            throw std::runtime_error(
+                "Given DataBuffer still has " + std::to_string(buffer.getViewCount()) +
+                " live views, deallocate them first."
+            );
+
+        // views don't occupy memory of their own
+        if (buffer.isView())
+            --buffer.mParent->mViewCount;
+        else
+            mLiveBytes -= buffer.getCapacity();
 
-    mDataBuffers.erase(it);
+        mDataBuffers.erase(it);
+    }
+
+    // the destructor may wait for commands still using the buffer,
+    // that must not block other threads allocating on this device
     delete &buffer;
 }
 
+bool Device::canWrapHostMemory(const void* hostPtr, const size_t size) const
+{
+    if (hostPtr == nullptr || size == 0)
+        return false;
+
+    return reinterpret_cast<uintptr_t>(hostPtr) % mMemBaseAddrAlign == 0;
+}
+
+void Device::setMemoryBudget(size_t bytes)
+{
+    if (bytes > mGlobalMemSize)
+        throw std::invalid_argument(
+            "Memory budget can't exceed CL_DEVICE_GLOBAL_MEM_SIZE (" +
+            std::to_string(mGlobalMemSize) + " bytes).");
+
+    std::lock_guard<std::mutex> lock(mDataBuffersMutex);
+    mMemoryBudget = bytes;
+
+    // unused memory cached by the pool counts towards the budget as well
+    const size_t available = mMemoryBudget > mLiveBytes ? mMemoryBudget - mLiveBytes : 0;
+    if (mBufferPool.getCachedBytes() > available)
+        mBufferPool.trim(available);
+}
+
+void Device::reserveMemory(size_t size)
+{
+    if (size > mMaxMemAllocSize)
+        throw DeviceMemoryBudgetExceeded(
+            "Allocation exceeds CL_DEVICE_MAX_MEM_ALLOC_SIZE.", size, mMaxMemAllocSize);
+
+    std::lock_guard<std::mutex> lock(mDataBuffersMutex);
+
+    const size_t available = mMemoryBudget > mLiveBytes ? mMemoryBudget - mLiveBytes : 0;
+    if (size > available)
+        throw DeviceMemoryBudgetExceeded(
+            "Allocation exceeds the memory budget of device '" + getName() + "'.", size, available);
+
+    mLiveBytes += size;
+    mPeakBytes = std::max(mPeakBytes, mLiveBytes);
+    ++mAllocationCount;
+}
+
+void Device::releaseMemory(size_t size)
+{
+    std::lock_guard<std::mutex> lock(mDataBuffersMutex);
+    mLiveBytes -= size;
+    --mAllocationCount;
+}
+
+void Device::registerBuffer(DataBuffer* buffer, size_t reservedSize)
+{
+    std::lock_guard<std::mutex> lock(mDataBuffersMutex);
+    mDataBuffers.push_back(buffer);
+
+    // the pool may hand out a different capacity than we have reserved
+    mLiveBytes = mLiveBytes - reservedSize + buffer->getCapacity();
+    mPeakBytes = std::max(mPeakBytes, mLiveBytes);
+
+    // we trim only after the buffer got its memory, trimming before the acquire
+    // could release the very memory object it would have reused
+    const size_t available = mMemoryBudget > mLiveBytes ? mMemoryBudget - mLiveBytes : 0;
+    if (mBufferPool.getCachedBytes() > available)
+        mBufferPool.trim(available);
+}
+
 unsigned int Device::getCapacity() const
 {
-    // TODO: This is completely arbitrary for now
-    return 3;
+    return mCapacity;
+}
+
+void Device::setCapacity(unsigned int capacity)
+{
+    mCapacity = capacity;
+}
+
+cl_device_type Device::getType() const
+{
+    cl_device_type ret;
+    CLErrorGuard(clGetDeviceInfo(mCLDeviceID, CL_DEVICE_TYPE, sizeof(ret), &ret, nullptr));
+    return ret;
+}
+
+unsigned int Device::getMaxComputeUnits() const
+{
+    cl_uint ret;
+    CLErrorGuard(clGetDeviceInfo(mCLDeviceID, CL_DEVICE_MAX_COMPUTE_UNITS, sizeof(ret), &ret, nullptr));
+    return ret;
+}
+
+unsigned int Device::getMaxClockFrequency() const
+{
+    cl_uint ret;
+    CLErrorGuard(clGetDeviceInfo(mCLDeviceID, CL_DEVICE_MAX_CLOCK_FREQUENCY, sizeof(ret), &ret, nullptr));
+    return ret;
+}
+
+unsigned int Device::estimateCapacity() const
+{
+    const cl_device_type type = getType();
+
+    // a GPU compute unit executes a whole wavefront/warp at once, a CPU
+    // core only gets a few lanes out of its vector units
+    unsigned int typeFactor = 1;
+    if (type & CL_DEVICE_TYPE_GPU)
+        typeFactor = 8;
+    else if (type & CL_DEVICE_TYPE_ACCELERATOR)
+        typeFactor = 4;
+
+    // some implementations report 0 for the clock, don't let that zero everything
+    const unsigned long long clock = std::max(getMaxClockFrequency(), 1u);
+    const unsigned long long estimate =
+        static_cast<unsigned long long>(std::max(getMaxComputeUnits(), 1u)) * clock * typeFactor;
+
+    return static_cast<unsigned int>(std::min<unsigned long long>(estimate, UINT_MAX));
+}
+
+size_t Device::getBlocksPerWorkItem() const
+{
+    return mBlocksPerWorkItem;
+}
+
+void Device::setBlocksPerWorkItem(size_t blocks)
+{
+    if (blocks == 0 || blocks > MaxBlocksPerWorkItem)
+        throw std::invalid_argument(
+            "Can't process " + std::to_string(blocks) + " blocks per work item, has to be 1 to " +
+            std::to_string(MaxBlocksPerWorkItem) + ".");
+
+    mBlocksPerWorkItem = blocks;
 }
 
 unsigned int Device::suggestLocalWorkSize() const
 {
-    // TODO: This is completely arbitrary for now
-    return 1;
+    return 0;
+}
+
+size_t Device::suggestLocalWorkSize(const std::string& kernelName, const std::string& variant) const
+{
+    std::lock_guard<std::mutex> lock(mTunedLocalWorkSizesMutex);
+
+    LocalWorkSizeMap::const_iterator it = mTunedLocalWorkSizes.find(std::make_pair(kernelName, variant));
+    if (it == mTunedLocalWorkSizes.end())
+        return suggestLocalWorkSize();
+
+    return it->second;
+}
+
+void Device::setTunedLocalWorkSize(const std::string& kernelName, const std::string& variant, size_t size)
+{
+    std::lock_guard<std::mutex> lock(mTunedLocalWorkSizesMutex);
+    mTunedLocalWorkSizes[std::make_pair(kernelName, variant)] = size;
+}
+
+Device::LocalWorkSizeMap Device::getTunedLocalWorkSizes() const
+{
+    std::lock_guard<std::mutex> lock(mTunedLocalWorkSizesMutex);
+    return mTunedLocalWorkSizes;
+}
+
+void Device::setTunedLocalWorkSizes(const LocalWorkSizeMap& sizes)
+{
+    std::lock_guard<std::mutex> lock(mTunedLocalWorkSizesMutex);
+    mTunedLocalWorkSizes = sizes;
 }
 
 }
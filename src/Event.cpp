@@ -0,0 +1,174 @@
+/*
+ * Copyright (C) 2015 Martin Preisler <martin@preisler.me>
+ *
+ * This file is part of oclcrypto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "oclcrypto/Event.h"
+#include "oclcrypto/CLError.h"
+
+#include <stdexcept>
+#include <utility>
+
+namespace oclcrypto
+{
+
+Event::Event():
+    mCLEvent(nullptr),
+    mFirstCLEvent(nullptr)
+{}
+
+Event::Event(cl_event event):
+    mCLEvent(event),
+    mFirstCLEvent(nullptr)
+{}
+
+Event::Event(cl_event first, cl_event last):
+    mCLEvent(last),
+    mFirstCLEvent(first)
+{}
+
+Event::Event(const Event& other):
+    mCLEvent(other.mCLEvent),
+    mFirstCLEvent(other.mFirstCLEvent)
+{
+    if (mCLEvent)
+        CLErrorGuard(clRetainEvent(mCLEvent));
+
+    if (mFirstCLEvent)
+        CLErrorGuard(clRetainEvent(mFirstCLEvent));
+}
+
+Event::Event(Event&& other):
+    mCLEvent(other.mCLEvent),
+    mFirstCLEvent(other.mFirstCLEvent)
+{
+    other.mCLEvent = nullptr;
+    other.mFirstCLEvent = nullptr;
+}
+
+Event::~Event()
+{
+    try
+    {
+        if (mCLEvent)
+            CLErrorGuard(clReleaseEvent(mCLEvent));
+
+        if (mFirstCLEvent)
+            CLErrorGuard(clReleaseEvent(mFirstCLEvent));
+    }
+    catch (...)
+    {
+        // TODO: log
+    }
+}
+
+Event& Event::operator=(const Event& other)
+{
+    Event copy(other);
+    std::swap(mCLEvent, copy.mCLEvent);
+    std::swap(mFirstCLEvent, copy.mFirstCLEvent);
+    return *this;
+}
+
+Event& Event::operator=(Event&& other)
+{
+    std::swap(mCLEvent, other.mCLEvent);
+    std::swap(mFirstCLEvent, other.mFirstCLEvent);
+    return *this;
+}
+
+void Event::wait() const
+{
+    if (!mCLEvent)
+        return;
+
+    CLErrorGuard(clWaitForEvents(1, &mCLEvent));
+}
+
+bool Event::isComplete() const
+{
+    if (!mCLEvent)
+        return true;
+
+    cl_int status;
+    CLErrorGuard(clGetEventInfo(mCLEvent, CL_EVENT_COMMAND_EXECUTION_STATUS, sizeof(status), &status, nullptr));
+
+    // negative values are errors, the command was terminated
+    if (status < 0)
+        CLErrorGuard(status);
+
+    return status == CL_COMPLETE;
+}
+
+cl_ulong Event::getQueuedTime() const
+{
+    return getProfilingInfo(CL_PROFILING_COMMAND_QUEUED, true);
+}
+
+cl_ulong Event::getSubmitTime() const
+{
+    return getProfilingInfo(CL_PROFILING_COMMAND_SUBMIT, true);
+}
+
+cl_ulong Event::getStartTime() const
+{
+    return getProfilingInfo(CL_PROFILING_COMMAND_START, true);
+}
+
+cl_ulong Event::getEndTime() const
+{
+    return getProfilingInfo(CL_PROFILING_COMMAND_END, false);
+}
+
+cl_ulong Event::getDuration() const
+{
+    return getEndTime() - getStartTime();
+}
+
+std::vector<cl_event> Event::getCLEvents(const std::vector<Event>& events)
+{
+    std::vector<cl_event> ret;
+    ret.reserve(events.size());
+
+    for (std::vector<Event>::const_iterator it = events.begin(); it != events.end(); ++it)
+    {
+        if (it->mCLEvent)
+            ret.push_back(it->mCLEvent);
+    }
+
+    return ret;
+}
+
+cl_ulong Event::getProfilingInfo(cl_profiling_info param, bool first) const
+{
+    if (!mCLEvent)
+        throw std::runtime_error("Can't query profiling info of an empty Event.");
+
+    const cl_event event = first && mFirstCLEvent ? mFirstCLEvent : mCLEvent;
+
+    cl_ulong ret = 0;
+    CLErrorGuard(clGetEventProfilingInfo(event, param, sizeof(ret), &ret, nullptr));
+    return ret;
+}
+
+}
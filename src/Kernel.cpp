@@ -28,13 +28,19 @@
 #include "oclcrypto/Program.h"
 #include "oclcrypto/DataBuffer.h"
 #include "oclcrypto/Device.h"
+#include "oclcrypto/LaunchPlanner.h"
+
+#include <algorithm>
+#include <stdexcept>
 
 namespace oclcrypto
 {
 
 Kernel::Kernel(Program& program, const std::string& name):
     mProgram(program),
-    mName(name)
+    mName(name),
+    mQueueIndex(0),
+    mItemCount(0)
 {
     cl_int err;
     mCLKernel = clCreateKernel(program.getCLProgram(), name.c_str(), &err);
@@ -63,34 +69,142 @@ const std::string& Kernel::getName() const
     return mName;
 }
 
+size_t Kernel::getWorkGroupSize() const
+{
+    size_t ret;
+    CLErrorGuard(clGetKernelWorkGroupInfo(mCLKernel, mProgram.getDevice().getCLDeviceID(),
+        CL_KERNEL_WORK_GROUP_SIZE, sizeof(ret), &ret, nullptr));
+    return ret;
+}
+
+size_t Kernel::getPreferredWorkGroupSizeMultiple() const
+{
+#ifdef CL_VERSION_1_1
+    if (mProgram.getDevice().supportsCLVersion(1, 1))
+    {
+        size_t ret;
+        CLErrorGuard(clGetKernelWorkGroupInfo(mCLKernel, mProgram.getDevice().getCLDeviceID(),
+            CL_KERNEL_PREFERRED_WORK_GROUP_SIZE_MULTIPLE, sizeof(ret), &ret, nullptr));
+        return std::max<size_t>(ret, 1);
+    }
+#endif
+
+    return 1;
+}
+
+size_t Kernel::suggestLocalWorkSize() const
+{
+    return mProgram.getDevice().suggestLocalWorkSize(mName, mProgram.getVariant());
+}
+
+size_t Kernel::getQueueIndex() const
+{
+    return mQueueIndex;
+}
+
+void Kernel::setQueueIndex(size_t idx)
+{
+    mQueueIndex = idx;
+}
+
 void Kernel::setParameter(size_t idx, DataBuffer& buffer)
 {
     CLErrorGuard(clSetKernelArg(mCLKernel, idx, sizeof(cl_mem), buffer.getCLMemPtr()));
+    // the buffer will be used by commands on our queue from now on
+    buffer.mQueueUsed = true;
+    mBufferParameters[idx] = &buffer;
 }
 
 void Kernel::setParameterPOD(size_t idx, size_t podSize, const void* pod)
 {
     CLErrorGuard(clSetKernelArg(mCLKernel, idx, podSize, pod));
+    mBufferParameters.erase(idx);
 }
 
 void Kernel::allocateLocalParameter(size_t idx, size_t elementSize, size_t elements)
 {
     CLErrorGuard(clSetKernelArg(mCLKernel, idx, elementSize * elements, nullptr));
+    mBufferParameters.erase(idx);
 }
 
-void Kernel::execute(size_t globalWorkSize, size_t localWorkSize, bool blockUntilComplete)
+Event Kernel::execute(size_t globalWorkSize, size_t localWorkSize, bool blockUntilComplete,
+                     const EventList& waitList)
 {
-    const cl_command_queue queue = mProgram.getDevice().getCLQueue();
+    return enqueue(globalWorkSize, localWorkSize, false, blockUntilComplete, waitList);
+}
 
-    CLErrorGuard(
-        clEnqueueNDRangeKernel(
-            queue, mCLKernel, 1, nullptr,
-            &globalWorkSize, localWorkSize == 0 ? nullptr : &localWorkSize, 0, nullptr, nullptr
-        )
-    );
+Event Kernel::executeBounded(size_t itemCount, size_t localWorkSize, size_t itemCountIdx,
+                             bool blockUntilComplete, const EventList& waitList,
+                             size_t itemsPerWorkItem)
+{
+    if (itemsPerWorkItem == 0)
+        throw std::invalid_argument("Each work item has to process at least one item.");
+
+    mItemCount = itemCount;
+    setParameter(itemCountIdx, &mItemCount);
+
+    const size_t workItemCount = (itemCount + itemsPerWorkItem - 1) / itemsPerWorkItem;
+    return enqueue(workItemCount, localWorkSize, true, blockUntilComplete, waitList);
+}
+
+Event Kernel::enqueue(size_t itemCount, size_t localWorkSize, bool boundsChecked,
+                      bool blockUntilComplete, const EventList& waitList)
+{
+    if (itemCount == 0)
+        throw std::invalid_argument("Can't execute a kernel with no work items.");
+
+    const Device& device = mProgram.getDevice();
+    const cl_command_queue queue = device.getCLQueue(mQueueIndex);
+    const std::vector<cl_event> clWaitList = Event::getCLEvents(waitList);
+
+    if (localWorkSize == TunedLocalWorkSize)
+        localWorkSize = suggestLocalWorkSize();
+
+    const LaunchPlanner::LaunchList launches = LaunchPlanner::plan(itemCount, localWorkSize, boundsChecked);
+
+    if (launches.size() > 1 && !device.supportsCLVersion(1, 1))
+        throw std::runtime_error(
+            "Running " + std::to_string(itemCount) + " work items takes multiple launches "
+            "with global offsets, the device doesn't support OpenCL 1.1.");
 
+    cl_event firstCLEvent = nullptr;
+    cl_event clEvent = nullptr;
+    for (LaunchPlanner::LaunchList::const_iterator it = launches.begin(); it != launches.end(); ++it)
+    {
+        // the queue is in-order, only the first launch has to wait for the list
+        // and the event of the last one signals completion of all of them,
+        // the first event is kept for the start of the profiling span
+        if (clEvent && clEvent != firstCLEvent)
+            CLErrorGuard(clReleaseEvent(clEvent));
+
+        const bool first = it == launches.begin();
+        CLErrorGuard(
+            clEnqueueNDRangeKernel(
+                queue, mCLKernel, 1, it->offset == 0 ? nullptr : &it->offset,
+                &it->globalWorkSize, it->localWorkSize == 0 ? nullptr : &it->localWorkSize,
+                first ? clWaitList.size() : 0, first && !clWaitList.empty() ? clWaitList.data() : nullptr,
+                &clEvent
+            )
+        );
+
+        if (first)
+            firstCLEvent = clEvent;
+    }
+
+    if (firstCLEvent == clEvent)
+        firstCLEvent = nullptr;
+
+    Event ret(firstCLEvent, clEvent);
+
+    for (std::map<size_t, DataBuffer*>::const_iterator it = mBufferParameters.begin();
+         it != mBufferParameters.end(); ++it)
+        it->second->recordLastEvent(clEvent);
+
+    // only wait for this kernel, not for everything else in the queue
     if (blockUntilComplete)
-        CLErrorGuard(clFinish(queue));
+        ret.wait();
+
+    return ret;
 }
 
 ScopedKernel::ScopedKernel(Kernel& kernel):
@@ -0,0 +1,82 @@
+/*
+ * Copyright (C) 2015 Martin Preisler <martin@preisler.me>
+ *
+ * This file is part of oclcrypto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "oclcrypto/LaunchPlanner.h"
+
+#include <algorithm>
+
+namespace oclcrypto
+{
+
+LaunchPlanner::LaunchList LaunchPlanner::plan(size_t itemCount, size_t localWorkSize, bool boundsChecked,
+                                              size_t maxLaunchSize)
+{
+    LaunchList ret;
+    if (itemCount == 0)
+        return ret;
+
+    size_t globalWorkSize = itemCount;
+
+    if (localWorkSize != 0)
+    {
+        // a work-group can't be larger than a launch
+        localWorkSize = std::min(localWorkSize, maxLaunchSize);
+
+        if (boundsChecked)
+        {
+            // the kernel skips the extra items of the last work-group
+            globalWorkSize = (itemCount + localWorkSize - 1) / localWorkSize * localWorkSize;
+        }
+        else if (itemCount % localWorkSize != 0)
+        {
+            // the greatest common divisor is the largest size that divides
+            // the count and isn't larger than what was asked for
+            size_t a = itemCount, b = localWorkSize;
+            while (b != 0)
+            {
+                const size_t t = a % b;
+                a = b;
+                b = t;
+            }
+            localWorkSize = a;
+        }
+
+        // every launch but the last has to be made of whole work-groups too
+        maxLaunchSize -= maxLaunchSize % localWorkSize;
+    }
+
+    for (size_t offset = 0; offset < globalWorkSize; offset += maxLaunchSize)
+    {
+        Launch launch;
+        launch.offset = offset;
+        launch.globalWorkSize = std::min(maxLaunchSize, globalWorkSize - offset);
+        launch.localWorkSize = localWorkSize;
+        ret.push_back(launch);
+    }
+
+    return ret;
+}
+
+}
@@ -27,46 +27,52 @@
 #include "oclcrypto/CLError.h"
 #include "oclcrypto/Device.h"
 #include "oclcrypto/Kernel.h"
+#include "oclcrypto/ProgramBinaryCache.h"
 
 #include <algorithm>
 
 namespace oclcrypto
 {
 
-Program::Program(Device& device, const std::string& source):
+Program::Program(Device& device, const std::string& source, ProgramBinaryCache* binaryCache,
+                 const std::string& extraBuildOptions):
     mDevice(device),
-    mSource(source)
+    mSource(source),
+    mVariant(extraBuildOptions),
+    mBuildOptions(std::string("-cl-strict-aliasing ") +
+        (device.getEndianess() == E_LITTLE_ENDIAN ? "-D LITTLE_ENDIAN" : "-D BIG_ENDIAN") +
+        (extraBuildOptions.empty() ? "" : " " + extraBuildOptions)),
+    mFromBinaryCache(false),
+
+    mCLProgram(nullptr)
 {
+    std::string cacheKey;
+    if (binaryCache)
     {
-        const char* src = source.c_str();
-        const size_t length = source.length();
+        cacheKey = ProgramBinaryCache::makeKey(device, mBuildOptions, source);
 
-        cl_int err;
-        mCLProgram = clCreateProgramWithSource(
-            device.getCLContext(), 1,
-            (const char** const)&src, &length,
-            &err
-        );
-
-        CLErrorGuard(err);
+        std::vector<unsigned char> binary;
+        if (binaryCache->load(cacheKey, binary))
+            mFromBinaryCache = buildFromBinary(binary);
     }
 
-    const cl_device_id deviceId = device.getCLDeviceID();
-    std::string options = std::string("-cl-strict-aliasing ") +
-        (mDevice.getEndianess() == E_LITTLE_ENDIAN ? "-D LITTLE_ENDIAN" : "-D BIG_ENDIAN");
-    const cl_int err = clBuildProgram(mCLProgram, 1, &deviceId, options.c_str(), nullptr, nullptr);
-
-    if (err != CL_SUCCESS)
+    if (!mFromBinaryCache)
     {
-        size_t size;
-        clGetProgramBuildInfo(mCLProgram, deviceId, CL_PROGRAM_BUILD_LOG, 0, nullptr, &size);
-        std::unique_ptr<char[]> buf(new char[size + 1]);
-        clGetProgramBuildInfo(mCLProgram, deviceId, CL_PROGRAM_BUILD_LOG, size, buf.get(), nullptr);
-
-        // OpenCL should append \0 but it never hurts to safe-guard ourselves
-        buf[size] = '\0';
-
-        CLProgramCompilationErrorThrow(err, std::string(buf.get()));
+        buildFromSource();
+
+        if (binaryCache)
+        {
+            // the cache is best effort, a program that built fine must not be
+            // lost (and leak mCLProgram) because its binary couldn't be stored
+            try
+            {
+                binaryCache->store(cacheKey, getBinary());
+            }
+            catch (...)
+            {
+                // TODO: log?
+            }
+        }
     }
 }
 
@@ -96,12 +102,15 @@ const std::string& Program::getSource() const
 Kernel& Program::createKernel(const std::string& name)
 {
     Kernel* ret = new Kernel(*this, name);
+
+    std::lock_guard<std::mutex> lock(mKernelsMutex);
     mKernels.push_back(ret);
     return *ret;
 }
 
 void Program::destroyKernel(Kernel& kernel)
 {
+    std::lock_guard<std::mutex> lock(mKernelsMutex);
     KernelVector::iterator it = std::find(mKernels.begin(), mKernels.end(), &kernel);
 
     if (it == mKernels.end())
@@ -113,6 +122,7 @@ void Program::destroyKernel(Kernel& kernel)
 
 size_t Program::getKernelCount() const
 {
+    std::lock_guard<std::mutex> lock(mKernelsMutex);
     return mKernels.size();
 }
 
@@ -121,6 +131,102 @@ cl_program Program::getCLProgram() const
     return mCLProgram;
 }
 
+const std::string& Program::getBuildOptions() const
+{
+    return mBuildOptions;
+}
+
+const std::string& Program::getVariant() const
+{
+    return mVariant;
+}
+
+bool Program::isFromBinaryCache() const
+{
+    return mFromBinaryCache;
+}
+
+std::vector<unsigned char> Program::getBinary() const
+{
+    // we always build for exactly one device
+    size_t size = 0;
+    CLErrorGuard(clGetProgramInfo(mCLProgram, CL_PROGRAM_BINARY_SIZES, sizeof(size), &size, nullptr));
+
+    std::vector<unsigned char> ret(size);
+    if (size > 0)
+    {
+        unsigned char* data = ret.data();
+        CLErrorGuard(clGetProgramInfo(mCLProgram, CL_PROGRAM_BINARIES, sizeof(data), &data, nullptr));
+    }
+
+    return ret;
+}
+
+bool Program::buildFromBinary(const std::vector<unsigned char>& binary)
+{
+    const cl_device_id deviceId = mDevice.getCLDeviceID();
+    const unsigned char* data = binary.data();
+    const size_t size = binary.size();
+
+    cl_int binaryStatus = CL_SUCCESS;
+    cl_int err;
+    cl_program program = clCreateProgramWithBinary(
+        mDevice.getCLContext(), 1, &deviceId,
+        &size, &data, &binaryStatus, &err
+    );
+
+    if (err != CL_SUCCESS)
+        return false;
+
+    // a binary the implementation rejects is just a cache miss, we build from source then
+    if (binaryStatus != CL_SUCCESS ||
+        clBuildProgram(program, 1, &deviceId, mBuildOptions.c_str(), nullptr, nullptr) != CL_SUCCESS)
+    {
+        clReleaseProgram(program);
+        return false;
+    }
+
+    mCLProgram = program;
+    return true;
+}
+
+void Program::buildFromSource()
+{
+    {
+        const char* src = mSource.c_str();
+        const size_t length = mSource.length();
+
+        cl_int err;
+        mCLProgram = clCreateProgramWithSource(
+            mDevice.getCLContext(), 1,
+            (const char** const)&src, &length,
+            &err
+        );
+
+        CLErrorGuard(err);
+    }
+
+    const cl_device_id deviceId = mDevice.getCLDeviceID();
+    const cl_int err = clBuildProgram(mCLProgram, 1, &deviceId, mBuildOptions.c_str(), nullptr, nullptr);
+
+    if (err != CL_SUCCESS)
+    {
+        size_t size;
+        clGetProgramBuildInfo(mCLProgram, deviceId, CL_PROGRAM_BUILD_LOG, 0, nullptr, &size);
+        std::unique_ptr<char[]> buf(new char[size + 1]);
+        clGetProgramBuildInfo(mCLProgram, deviceId, CL_PROGRAM_BUILD_LOG, size, buf.get(), nullptr);
+
+        // OpenCL should append \0 but it never hurts to safe-guard ourselves
+        buf[size] = '\0';
+
+        // the destructor won't run, we have to release the program ourselves
+        clReleaseProgram(mCLProgram);
+        mCLProgram = nullptr;
+
+        CLProgramCompilationErrorThrow(err, std::string(buf.get()));
+    }
+}
+
 ScopedProgram::ScopedProgram(Program& program):
     mProgram(program)
 {}
@@ -0,0 +1,187 @@
+/*
+ * Copyright (C) 2015 Martin Preisler <martin@preisler.me>
+ *
+ * This file is part of oclcrypto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "oclcrypto/ProgramBinaryCache.h"
+#include "oclcrypto/Device.h"
+
+#include <cstdio>
+#include <fstream>
+#include <random>
+#include <sstream>
+
+#ifdef _WIN32
+#   include <direct.h>
+#else
+#   include <sys/stat.h>
+#   include <sys/types.h>
+#endif
+
+namespace oclcrypto
+{
+
+namespace
+{
+
+// bump this whenever the entry format changes
+const char EntryMagic[] = "oclcrypto-program-binary-1";
+
+std::string toHex(uint64_t value)
+{
+    char buffer[17];
+    std::snprintf(buffer, sizeof(buffer), "%016llx", static_cast<unsigned long long>(value));
+    return std::string(buffer, 16);
+}
+
+}
+
+const char* const ProgramBinaryCache::DirectoryEnvironmentVariable = "OCLCRYPTO_PROGRAM_CACHE_DIR";
+
+ProgramBinaryCache::ProgramBinaryCache(const std::string& directory):
+    mDirectory(directory)
+{
+    if (directory.empty())
+        throw std::invalid_argument("Program binary cache directory can't be empty.");
+
+    // failure is fine, the directory most likely exists already
+#ifdef _WIN32
+    _mkdir(directory.c_str());
+#else
+    mkdir(directory.c_str(), 0755);
+#endif
+}
+
+const std::string& ProgramBinaryCache::getDirectory() const
+{
+    return mDirectory;
+}
+
+std::string ProgramBinaryCache::makeKey(const Device& device, const std::string& buildOptions, const std::string& source)
+{
+    std::ostringstream key;
+    // getName may include the terminating null character
+    key << "device: " << device.getName().c_str() << "\n"
+        << "device version: " << device.getVersion() << "\n"
+        << "driver version: " << device.getDriverVersion() << "\n"
+        << "build options: " << buildOptions << "\n"
+        << "source: " << toHex(hash(source)) << " " << source.size() << "\n";
+    return key.str();
+}
+
+bool ProgramBinaryCache::load(const std::string& key, std::vector<unsigned char>& binary) const
+{
+    std::ifstream file(getEntryPath(key), std::ios::in | std::ios::binary);
+    if (!file)
+        return false;
+
+    std::string magic;
+    if (!std::getline(file, magic, '\0') || magic != EntryMagic)
+        return false;
+
+    // the file name is just a hash, the full key has to match
+    std::string storedKey;
+    if (!std::getline(file, storedKey, '\0') || storedKey != key)
+        return false;
+
+    uint64_t size = 0;
+    if (!file.read(reinterpret_cast<char*>(&size), sizeof(size)) || size == 0)
+        return false;
+
+    std::vector<unsigned char> ret(static_cast<size_t>(size));
+    if (!file.read(reinterpret_cast<char*>(ret.data()), ret.size()))
+        return false;
+
+    // trailing data means the entry is damaged
+    if (file.peek() != std::ifstream::traits_type::eof())
+        return false;
+
+    binary.swap(ret);
+    return true;
+}
+
+bool ProgramBinaryCache::store(const std::string& key, const std::vector<unsigned char>& binary) const
+{
+    if (binary.empty())
+        return false;
+
+    const std::string path = getEntryPath(key);
+    std::random_device random;
+    const std::string temporaryPath = path + ".tmp" + std::to_string(random());
+
+    {
+        std::ofstream file(temporaryPath, std::ios::out | std::ios::binary | std::ios::trunc);
+        if (!file)
+            return false;
+
+        const uint64_t size = binary.size();
+        file.write(EntryMagic, sizeof(EntryMagic));
+        file.write(key.c_str(), key.size() + 1);
+        file.write(reinterpret_cast<const char*>(&size), sizeof(size));
+        file.write(reinterpret_cast<const char*>(binary.data()), binary.size());
+
+        file.close();
+        if (!file)
+        {
+            std::remove(temporaryPath.c_str());
+            return false;
+        }
+    }
+
+#ifdef _WIN32
+    // rename doesn't replace existing files on Windows
+    std::remove(path.c_str());
+#endif
+
+    if (std::rename(temporaryPath.c_str(), path.c_str()) != 0)
+    {
+        std::remove(temporaryPath.c_str());
+        return false;
+    }
+
+    return true;
+}
+
+bool ProgramBinaryCache::remove(const std::string& key) const
+{
+    return std::remove(getEntryPath(key).c_str()) == 0;
+}
+
+uint64_t ProgramBinaryCache::hash(const std::string& data)
+{
+    uint64_t ret = 14695981039346656037ULL;
+    for (std::string::const_iterator it = data.begin(); it != data.end(); ++it)
+    {
+        ret ^= static_cast<unsigned char>(*it);
+        ret *= 1099511628211ULL;
+    }
+
+    return ret;
+}
+
+std::string ProgramBinaryCache::getEntryPath(const std::string& key) const
+{
+    return mDirectory + "/" + toHex(hash(key)) + ".bin";
+}
+
+}
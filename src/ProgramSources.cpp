@@ -36,4 +36,51 @@ const char* ProgramSources::msSources[] =
     nullptr
 };
 
+std::string ProgramSources::getBuildOptions(const Defines& defines)
+{
+    std::string ret;
+    for (Defines::const_iterator it = defines.begin(); it != defines.end(); ++it)
+    {
+        if (!ret.empty())
+            ret += " ";
+
+        ret += "-D " + it->first;
+        if (!it->second.empty())
+            ret += "=" + it->second;
+    }
+
+    return ret;
+}
+
+std::vector<ProgramSources::Defines> ProgramSources::getVariants(ProgramType type)
+{
+    std::vector<Defines> ret;
+
+    if (type == AES)
+    {
+        // one variant per key size with the round count known at compile time,
+        // AES_ROUNDS is the number of round keys just like the rounds argument,
+        // each byte-wise, with T-tables and bitsliced, see AES_Base::Implementation
+        const unsigned int roundKeys[] = {11, 13, 15};
+        for (unsigned int i = 0; i < 3; ++i)
+        {
+            Defines defines;
+            defines["AES_ROUNDS"] = std::to_string(roundKeys[i]);
+            ret.push_back(defines);
+
+            Defines tTables = defines;
+            tTables["AES_T_TABLES"] = "";
+            ret.push_back(tTables);
+
+            Defines bitsliced = defines;
+            bitsliced["AES_BITSLICED"] = "";
+            ret.push_back(bitsliced);
+        }
+    }
+    else
+        ret.push_back(Defines());
+
+    return ret;
+}
+
 }
@@ -26,15 +26,32 @@
 #include "oclcrypto/System.h"
 #include "oclcrypto/CLError.h"
 #include "oclcrypto/Device.h"
+#include "oclcrypto/ProgramBinaryCache.h"
+#include "oclcrypto/TaskScheduler.h"
+#include "oclcrypto/WorkGroupTuner.h"
 
+#include "oclcrypto/AES_ECB.h"
+
+#include <algorithm>
+#include <chrono>
+#include <climits>
+#include <cstdlib>
 #include <vector>
 #include <string>
 
 namespace oclcrypto
 {
 
-System::System(bool useCPUs)
+System::System(bool useCPUs, bool prebuildPrograms)
 {
+    const char* cacheDirectory = std::getenv(ProgramBinaryCache::DirectoryEnvironmentVariable);
+    if (cacheDirectory && *cacheDirectory)
+        setProgramBinaryCacheDirectory(cacheDirectory);
+
+    const char* preferredDevice = std::getenv(DeviceEnvironmentVariable);
+    if (preferredDevice)
+        setPreferredDevice(preferredDevice);
+
     cl_uint platformCount = 0;
     CLErrorGuard(clGetPlatformIDs(0, nullptr, &platformCount));
 
@@ -47,10 +64,30 @@ System::System(bool useCPUs)
     {
         initializePlatform(*it, useCPUs);
     }
+
+    loadTunedLocalWorkSizes();
+
+    if (prebuildPrograms)
+        this->prebuildPrograms();
 }
 
 System::~System()
 {
+    // workers run tasks on our devices
+    mTaskScheduler.reset();
+
+    // background builds reference the devices, we can't delete them under their hands
+    for (DeviceProgramCacheMap::const_iterator it = mDeviceProgramCacheMap.begin();
+         it != mDeviceProgramCacheMap.end(); ++it)
+    {
+        for (ProgramCacheMap::const_iterator pit = it->second.begin();
+             pit != it->second.end(); ++pit)
+        {
+            pit->second.wait();
+        }
+    }
+    mDeviceProgramCacheMap.clear();
+
     for (DeviceMap::const_iterator it = mDevices.begin();
          it != mDevices.end(); ++it)
     {
@@ -80,28 +117,283 @@ Device& System::getBestDevice()
     if (getDeviceCount() == 0)
         throw std::invalid_argument("No OpenCL devices found. Can't return the best device from an empty set.");
 
-    return getDevice(0);
+    if (mPreferredDevice.empty())
+        return getDevice(0);
+
+    if (mPreferredDevice.find_first_not_of("0123456789") == std::string::npos)
+    {
+        size_t idx = getDeviceCount();
+        try
+        {
+            idx = std::stoul(mPreferredDevice);
+        }
+        catch (const std::out_of_range&)
+        {
+            // too many digits to be an index, handled by the throw below
+        }
+
+        if (idx < getDeviceCount())
+            return getDevice(idx);
+    }
+    else
+    {
+        for (DeviceMap::const_iterator it = mDevices.begin(); it != mDevices.end(); ++it)
+        {
+            if (it->second->getName().find(mPreferredDevice) != std::string::npos)
+                return *it->second;
+        }
+    }
+
+    throw std::invalid_argument("Preferred device '" + mPreferredDevice + "' doesn't match any OpenCL device.");
+}
+
+const char* const System::DeviceEnvironmentVariable = "OCLCRYPTO_DEVICE";
+
+void System::setPreferredDevice(const std::string& selector)
+{
+    mPreferredDevice = selector;
+}
+
+const std::string& System::getPreferredDevice() const
+{
+    return mPreferredDevice;
+}
+
+void System::calibrateDevices(size_t bytes)
+{
+    bytes = std::max<size_t>(bytes - bytes % 16, 16);
+
+    // contents don't matter, AES takes the same time for any input
+    const std::vector<unsigned char> plaintext(bytes);
+    const unsigned char key[16] = {0};
+
+    DeviceMap calibrated;
+    for (DeviceMap::const_iterator it = mDevices.begin(); it != mDevices.end(); ++it)
+    {
+        Device& device = *it->second;
+
+        AES_ECB_Encrypt encrypt(*this, device);
+        encrypt.setKey(key, 16);
+        encrypt.setPlainText(plaintext.data(), bytes);
+
+        // the first run builds the kernel and warms up the driver, it isn't measured
+        encrypt.execute(device.suggestLocalWorkSize()).wait();
+
+        const int iterations = 3;
+        const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+        for (int i = 0; i < iterations; ++i)
+            encrypt.execute(device.suggestLocalWorkSize()).wait();
+
+        const long long elapsed = std::max<long long>(
+            std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count(), 1);
+
+        const unsigned long long throughput = static_cast<unsigned long long>(bytes) * iterations / elapsed;
+        device.setCapacity(static_cast<unsigned int>(std::max<unsigned long long>(std::min<unsigned long long>(throughput, UINT_MAX), 1)));
+
+        calibrated.insert(std::make_pair(device.getCapacity(), &device));
+    }
+
+    mDevices.swap(calibrated);
+}
+
+// programs get the blocks per work-item of their device unless the defines
+// set BLOCKS_PER_ITEM themselves
+static std::string getDeviceBuildOptions(const Device& device, ProgramSources::Defines defines)
+{
+    if (defines.find("BLOCKS_PER_ITEM") == defines.end())
+        defines["BLOCKS_PER_ITEM"] = std::to_string(device.getBlocksPerWorkItem());
+
+    return ProgramSources::getBuildOptions(defines);
+}
+
+// whether the build has finished with an exception, doesn't block
+static bool hasFailed(const std::shared_future<Program*>& build)
+{
+    if (build.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+        return false;
+
+    try
+    {
+        build.get();
+    }
+    catch (...)
+    {
+        return true;
+    }
+
+    return false;
+}
+
+Program& System::getProgramFromCache(Device& device, ProgramSources::ProgramType type,
+                                     const ProgramSources::Defines& defines)
+{
+    const ProgramCacheKey key(type, getDeviceBuildOptions(device, defines));
+
+    ProgramFuture future;
+    std::promise<Program*> promise;
+    std::shared_ptr<ProgramBinaryCache> binaryCache;
+    bool buildHere = false;
+    ProgramCacheMap* cacheMap = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(mProgramCacheMutex);
+
+        DeviceProgramCacheMap::iterator it = mDeviceProgramCacheMap.find(&device);
+
+        if (it == mDeviceProgramCacheMap.end())
+            throw std::invalid_argument("Given device is unknown to this oclcrypto::System.");
+
+        ProgramCacheMap& map = it->second;
+        ProgramCacheMap::const_iterator pit = map.find(key);
+
+        // background builds of prebuildPrograms can't remove their own failures
+        if (pit != map.end() && !hasFailed(pit->second))
+            future = pit->second;
+        else
+        {
+            // this program hasn't been cached yet, we will build it on this thread,
+            // anyone asking for it in the meantime waits for our promise
+            future = promise.get_future().share();
+            map[key] = future;
+            cacheMap = &map;
+            binaryCache = mProgramBinaryCache;
+            buildHere = true;
+        }
+    }
+
+    // might still be building elsewhere, get() waits for it outside the lock
+    if (!buildHere)
+        return *future.get();
+
+    try
+    {
+        Program& program = device.createProgram(ProgramSources::getProgramSource(type), binaryCache.get(), key.second);
+        promise.set_value(&program);
+    }
+    catch (...)
+    {
+        {
+            // failures may be transient, the next caller gets to build again
+            std::lock_guard<std::mutex> lock(mProgramCacheMutex);
+            cacheMap->erase(key);
+        }
+
+        // whoever is waiting right now gets the error
+        promise.set_exception(std::current_exception());
+    }
+
+    return *future.get();
+}
+
+void System::warmUp()
+{
+    prebuildPrograms();
+
+    std::vector<ProgramFuture> futures;
+    {
+        std::lock_guard<std::mutex> lock(mProgramCacheMutex);
+
+        for (DeviceProgramCacheMap::const_iterator it = mDeviceProgramCacheMap.begin();
+             it != mDeviceProgramCacheMap.end(); ++it)
+        {
+            for (ProgramCacheMap::const_iterator pit = it->second.begin();
+                 pit != it->second.end(); ++pit)
+            {
+                futures.push_back(pit->second);
+            }
+        }
+    }
+
+    // wait for everything before throwing so that nothing is left building
+    for (std::vector<ProgramFuture>::const_iterator it = futures.begin();
+         it != futures.end(); ++it)
+    {
+        it->wait();
+    }
+
+    for (std::vector<ProgramFuture>::const_iterator it = futures.begin();
+         it != futures.end(); ++it)
+    {
+        it->get();
+    }
 }
 
-Program& System::getProgramFromCache(Device& device, ProgramSources::ProgramType type)
+TaskPtr System::submit(const TaskPtr& task)
 {
-    DeviceProgramCacheMap::iterator it = mDeviceProgramCacheMap.find(&device);
+    getTaskScheduler().submit(task);
+    return task;
+}
 
-    if (it == mDeviceProgramCacheMap.end())
-        throw std::invalid_argument("Given device is unknown to this oclcrypto::System.");
+TaskScheduler& System::getTaskScheduler()
+{
+    std::lock_guard<std::mutex> lock(mTaskSchedulerMutex);
 
-    ProgramCacheMap& map = it->second;
-    ProgramCacheMap::const_iterator pit = map.find(type);
+    if (!mTaskScheduler)
+        mTaskScheduler.reset(new TaskScheduler(*this));
 
-    if (pit == map.end())
+    return *mTaskScheduler;
+}
+
+void System::setProgramBinaryCacheDirectory(const std::string& directory)
+{
     {
-        // this program hasn't been cached yet, lets create it and cache it
-        Program& program = device.createProgram(ProgramSources::getProgramSource(type));
-        map[type] = &program;
-        return program;
+        std::lock_guard<std::mutex> lock(mProgramCacheMutex);
+
+        if (directory.empty())
+            mProgramBinaryCache.reset();
+        else
+            mProgramBinaryCache.reset(new ProgramBinaryCache(directory));
     }
 
-    return *pit->second;
+    loadTunedLocalWorkSizes();
+}
+
+ProgramBinaryCache* System::getProgramBinaryCache() const
+{
+    return mProgramBinaryCache.get();
+}
+
+void System::loadTunedLocalWorkSizes()
+{
+    if (!mProgramBinaryCache)
+        return;
+
+    for (DeviceMap::const_iterator it = mDevices.begin(); it != mDevices.end(); ++it)
+        WorkGroupTuner::load(*it->second, *mProgramBinaryCache);
+}
+
+void System::prebuildPrograms()
+{
+    std::lock_guard<std::mutex> lock(mProgramCacheMutex);
+    // shared with the builds so that changing the cache directory meanwhile is safe
+    std::shared_ptr<ProgramBinaryCache> binaryCache = mProgramBinaryCache;
+
+    for (DeviceProgramCacheMap::iterator it = mDeviceProgramCacheMap.begin();
+         it != mDeviceProgramCacheMap.end(); ++it)
+    {
+        Device* device = it->first;
+        ProgramCacheMap& map = it->second;
+
+        for (int i = 0; i < ProgramSources::PROGRAM_COUNT; ++i)
+        {
+            const ProgramSources::ProgramType type = static_cast<ProgramSources::ProgramType>(i);
+            const std::vector<ProgramSources::Defines> variants = ProgramSources::getVariants(type);
+
+            for (std::vector<ProgramSources::Defines>::const_iterator vit = variants.begin();
+                 vit != variants.end(); ++vit)
+            {
+                const ProgramCacheKey key(type, getDeviceBuildOptions(*device, *vit));
+                ProgramCacheMap::const_iterator pit = map.find(key);
+                if (pit != map.end() && !hasFailed(pit->second))
+                    continue;
+
+                map[key] = std::async(std::launch::async, [device, key, binaryCache]()
+                {
+                    return &device->createProgram(ProgramSources::getProgramSource(key.first), binaryCache.get(), key.second);
+                }).share();
+            }
+        }
+    }
 }
 
 void System::initializePlatform(cl_platform_id platform, bool useCPUs)
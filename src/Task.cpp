@@ -0,0 +1,131 @@
+/*
+ * Copyright (C) 2015 Martin Preisler <martin@preisler.me>
+ *
+ * This file is part of oclcrypto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "oclcrypto/Task.h"
+
+#include <stdexcept>
+
+namespace oclcrypto
+{
+
+Task::Task(TaskAlgorithm algorithm, const std::vector<unsigned char>& input,
+           const std::vector<unsigned char>& secret, const std::vector<unsigned char>& iv):
+    algorithm(algorithm),
+
+    input(input),
+    secret(secret),
+    iv(iv),
+
+    mSubmitted(false),
+    mState(TS_SPECIFIED),
+    mDevice(nullptr),
+    mDone(false)
+{}
+
+void Task::setCallback(const Callback& callback)
+{
+    if (mSubmitted)
+        throw std::runtime_error("Can't set the callback of a task that has been submitted already.");
+
+    mCallback = callback;
+}
+
+void Task::wait() const
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mCompleted.wait(lock, [this]() { return mDone; });
+}
+
+const std::vector<unsigned char>& Task::getOutput() const
+{
+    const TaskState state = mState;
+
+    if (state == TS_ERROR)
+        std::rethrow_exception(mError);
+
+    if (state != TS_FINISHED)
+        throw std::runtime_error("The output is only valid once the task has finished.");
+
+    return mOutput;
+}
+
+std::exception_ptr Task::getError() const
+{
+    if (mState != TS_ERROR)
+        return std::exception_ptr();
+
+    return mError;
+}
+
+Device* Task::getDevice() const
+{
+    return mDevice;
+}
+
+void Task::setRunning(Device& device)
+{
+    mDevice = &device;
+    mState = TS_RUNNING;
+}
+
+void Task::setFinished(std::vector<unsigned char>& output)
+{
+    mOutput.swap(output);
+    complete(TS_FINISHED);
+}
+
+void Task::setError(std::exception_ptr error)
+{
+    mError = error;
+    complete(TS_ERROR);
+}
+
+void Task::complete(TaskState state)
+{
+    // the output and error are written before the state, readers checking
+    // the state see them complete
+    mState = state;
+
+    if (mCallback)
+    {
+        try
+        {
+            mCallback(*this);
+        }
+        catch (...)
+        {
+            // TODO: log
+        }
+    }
+
+    // waiters are released after the callback so that its effects are visible to them
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mDone = true;
+    }
+    mCompleted.notify_all();
+}
+
+}
@@ -0,0 +1,284 @@
+/*
+ * Copyright (C) 2015 Martin Preisler <martin@preisler.me>
+ *
+ * This file is part of oclcrypto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "oclcrypto/TaskScheduler.h"
+#include "oclcrypto/Task.h"
+#include "oclcrypto/System.h"
+#include "oclcrypto/Device.h"
+#include "oclcrypto/DataBuffer.h"
+#include "oclcrypto/AES_ECB.h"
+#include "oclcrypto/AES_CTR.h"
+#include "oclcrypto/AES_GCM.h"
+#include "oclcrypto/BLOWFISH_ECB.h"
+
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+
+namespace oclcrypto
+{
+
+TaskScheduler::TaskScheduler(System& system, size_t workerCount):
+    mSystem(system),
+
+    mRunningCount(0),
+    mStopping(false)
+{
+    if (mSystem.getDeviceCount() == 0)
+        throw std::invalid_argument("No OpenCL devices found. Can't schedule tasks without devices.");
+
+    for (size_t i = 0; i < mSystem.getDeviceCount(); ++i)
+        mDeviceLoads[&mSystem.getDevice(i)] = 0;
+
+    if (workerCount == 0)
+        workerCount = 2 * mDeviceLoads.size();
+
+    for (size_t i = 0; i < workerCount; ++i)
+        mWorkers.push_back(std::thread(&TaskScheduler::workerLoop, this));
+}
+
+TaskScheduler::~TaskScheduler()
+{
+    try
+    {
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            mStopping = true;
+        }
+        mQueueChanged.notify_all();
+
+        for (std::vector<std::thread>::iterator it = mWorkers.begin(); it != mWorkers.end(); ++it)
+            it->join();
+    }
+    catch (...)
+    {
+        // TODO: log
+    }
+}
+
+void TaskScheduler::submit(const TaskPtr& task)
+{
+    if (!task)
+        throw std::invalid_argument("Can't submit a null task.");
+
+    if (task->mSubmitted.exchange(true))
+        throw std::invalid_argument("Given task has been submitted already.");
+
+    {
+        std::lock_guard<std::mutex> lock(mMutex);
+        mQueue.push_back(task);
+    }
+    mQueueChanged.notify_one();
+}
+
+void TaskScheduler::waitIdle()
+{
+    std::unique_lock<std::mutex> lock(mMutex);
+    mIdle.wait(lock, [this]() { return mQueue.empty() && mRunningCount == 0; });
+}
+
+size_t TaskScheduler::getWorkerCount() const
+{
+    return mWorkers.size();
+}
+
+size_t TaskScheduler::getQueuedCount() const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    return mQueue.size();
+}
+
+size_t TaskScheduler::getDeviceLoad(const Device& device) const
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    DeviceLoadMap::const_iterator it = mDeviceLoads.find(const_cast<Device*>(&device));
+    if (it == mDeviceLoads.end())
+        throw std::invalid_argument("Given device is unknown to this oclcrypto::TaskScheduler.");
+
+    return it->second;
+}
+
+void TaskScheduler::workerLoop()
+{
+    while (true)
+    {
+        TaskPtr task;
+        {
+            std::unique_lock<std::mutex> lock(mMutex);
+            mQueueChanged.wait(lock, [this]() { return mStopping || !mQueue.empty(); });
+
+            // queued tasks are still run when stopping, nobody is left waiting forever
+            if (mQueue.empty())
+                return;
+
+            task = mQueue.front();
+            mQueue.pop_front();
+            ++mRunningCount;
+        }
+
+        const size_t bytes = std::max<size_t>(task->input.size(), 1);
+        Device& device = acquireDevice(bytes);
+        task->setRunning(device);
+
+        std::vector<unsigned char> output;
+        std::exception_ptr error;
+        try
+        {
+            run(device, *task, output);
+        }
+        catch (...)
+        {
+            error = std::current_exception();
+        }
+
+        releaseDevice(device, bytes);
+
+        if (error)
+            task->setError(error);
+        else
+            task->setFinished(output);
+
+        {
+            std::lock_guard<std::mutex> lock(mMutex);
+            --mRunningCount;
+        }
+        mIdle.notify_all();
+    }
+}
+
+Device& TaskScheduler::acquireDevice(size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+
+    DeviceLoadMap::iterator best = mDeviceLoads.end();
+    double bestLoad = std::numeric_limits<double>::max();
+
+    for (DeviceLoadMap::iterator it = mDeviceLoads.begin(); it != mDeviceLoads.end(); ++it)
+    {
+        // load the device would have with this task, relative to how much it can handle
+        const double load = static_cast<double>(it->second + bytes) / std::max(it->first->getCapacity(), 1u);
+        if (load < bestLoad)
+        {
+            bestLoad = load;
+            best = it;
+        }
+    }
+
+    best->second += bytes;
+    return *best->first;
+}
+
+void TaskScheduler::releaseDevice(Device& device, size_t bytes)
+{
+    std::lock_guard<std::mutex> lock(mMutex);
+    mDeviceLoads[&device] -= bytes;
+}
+
+void TaskScheduler::run(Device& device, const Task& task, std::vector<unsigned char>& output)
+{
+    const std::vector<unsigned char>& input = task.input;
+    output.resize(input.size());
+
+    switch (task.algorithm)
+    {
+        case TA_PASSTHROUGH:
+        {
+            if (input.empty())
+                break;
+
+            DataBuffer& buffer = device.allocateBuffer<unsigned char>(input.size());
+            try
+            {
+                buffer.write(input.data(), input.size());
+                buffer.read(output.data(), output.size());
+            }
+            catch (...)
+            {
+                device.deallocateBuffer(buffer);
+                throw;
+            }
+            device.deallocateBuffer(buffer);
+            break;
+        }
+        case TA_AES_ECB_ENCRYPT:
+        {
+            AES_ECB_Encrypt cipher(mSystem, device);
+            cipher.setKey(task.secret.data(), task.secret.size());
+            cipher.setPlainText(input.data(), input.size());
+            cipher.execute();
+            cipher.getCipherText()->read(output.data(), output.size());
+            break;
+        }
+        case TA_AES_ECB_DECRYPT:
+        {
+            AES_ECB_Decrypt cipher(mSystem, device);
+            cipher.setKey(task.secret.data(), task.secret.size());
+            cipher.setCipherText(input.data(), input.size());
+            cipher.execute();
+            cipher.getPlainText()->read(output.data(), output.size());
+            break;
+        }
+        case TA_AES_CTR_ENCRYPT:
+        {
+            if (task.iv.size() != 16)
+                throw std::invalid_argument("AES CTR task needs a 16 byte initial counter, got " + std::to_string(task.iv.size()) + " bytes.");
+
+            AES_CTR_Encrypt cipher(mSystem, device);
+            cipher.setKey(task.secret.data(), task.secret.size());
+            cipher.setInitialCounter(task.iv.data());
+            cipher.setPlainText(input.data(), input.size());
+            cipher.execute();
+            cipher.getCipherText()->read(output.data(), output.size());
+            break;
+        }
+        case TA_AES_GCM_ENCRYPT:
+        {
+            if (task.iv.size() != 12)
+                throw std::invalid_argument("AES GCM task needs a 12 byte initial vector, got " + std::to_string(task.iv.size()) + " bytes.");
+
+            AES_GCM_Encrypt cipher(mSystem, device);
+            cipher.setKey(task.secret.data(), task.secret.size());
+            cipher.setInitialVector(task.iv.data());
+            cipher.setPlainText(input.data(), input.size());
+            cipher.execute();
+            cipher.getCipherText()->read(output.data(), output.size());
+            break;
+        }
+        case TA_BLOWFISH_ECB_ENCRYPT:
+        {
+            BLOWFISH_ECB_Encrypt cipher(mSystem, device);
+            cipher.setKey(task.secret.data(), task.secret.size());
+            cipher.setPlainText(input.data(), input.size());
+            cipher.execute();
+            cipher.getCipherText()->read(output.data(), output.size());
+            break;
+        }
+        default:
+            throw std::invalid_argument("Unknown task algorithm " + std::to_string(task.algorithm) + ".");
+    }
+}
+
+}
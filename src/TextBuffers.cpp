@@ -0,0 +1,204 @@
+/*
+ * Copyright (C) 2015 Martin Preisler <martin@preisler.me>
+ *
+ * This file is part of oclcrypto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "oclcrypto/TextBuffers.h"
+#include "oclcrypto/DataBuffer.h"
+#include "oclcrypto/Device.h"
+
+#include <algorithm>
+#include <cctype>
+#include <stdexcept>
+
+namespace oclcrypto
+{
+
+static std::string capitalize(std::string text)
+{
+    if (!text.empty())
+        text[0] = static_cast<char>(std::toupper(static_cast<unsigned char>(text[0])));
+
+    return text;
+}
+
+TextBuffers::TextBuffers(Device& device, size_t blockSize, const std::string& cipherName, bool decryption):
+    mDevice(device),
+    mBlockSize(blockSize),
+    mCipherName(cipherName),
+    mInputName(decryption ? "ciphertext" : "plaintext"),
+    mOutputName(decryption ? "plaintext" : "ciphertext"),
+
+    mInput(nullptr),
+    mOutput(nullptr),
+
+    mInPlace(false)
+{}
+
+TextBuffers::~TextBuffers()
+{
+    try
+    {
+        if (mInput)
+            mDevice.deallocateBuffer(*mInput);
+
+        // in-place mode shares one buffer for both
+        if (mOutput && mOutput != mInput)
+            mDevice.deallocateBuffer(*mOutput);
+    }
+    catch (...)
+    {
+        // TODO: log?
+    }
+}
+
+void TextBuffers::setInput(const unsigned char* input, size_t size, size_t queueIndex)
+{
+    if (input == nullptr)
+        throw std::invalid_argument("Non-null " + mInputName + " is required");
+
+    checkSize(size);
+
+    // in-place mode needs a ReadWrite buffer, the kernel writes the output into it
+    const unsigned short memFlags = mInPlace ? DataBuffer::ReadWrite : DataBuffer::Read;
+
+    if (!mInput || mInput->isWrappingHostMemory() || mInput->isView() ||
+        mInput->getMemFlags() != memFlags || mInput->getArraySize<unsigned char>() != size)
+    {
+        deallocateInput();
+        mInput = &mDevice.allocateBuffer<unsigned char>(size, memFlags);
+        mInput->setQueueIndex(queueIndex);
+    }
+
+    {
+        auto data = mInput->lockOverwrite<unsigned char>();
+        std::copy(input, input + size, data.begin());
+    }
+
+    allocateOutput(size, queueIndex);
+}
+
+bool TextBuffers::wrapInput(const unsigned char* input, size_t size, size_t queueIndex)
+{
+    // in-place mode would write the output into caller's const memory
+    if (mInPlace || size % mBlockSize != 0 || !mDevice.canWrapHostMemory(input, size))
+    {
+        // setInput validates the input and copies it, it's our safe fallback
+        setInput(input, size, queueIndex);
+        return false;
+    }
+
+    deallocateInput();
+    // the buffer is read only on the device side, the kernel never writes to it
+    mInput = &mDevice.wrapHostMemory(const_cast<unsigned char*>(input), size, DataBuffer::Read);
+    mInput->setQueueIndex(queueIndex);
+
+    allocateOutput(size, queueIndex);
+
+    return true;
+}
+
+void TextBuffers::setInputView(DataBuffer& buffer, size_t offset, size_t size, size_t queueIndex)
+{
+    checkSize(size);
+
+    if (&buffer.getDevice() != &mDevice)
+        throw std::invalid_argument("Given DataBuffer belongs to another Device.");
+
+    if (mInPlace && buffer.getMemFlags() != DataBuffer::ReadWrite)
+        throw std::invalid_argument("In-place mode writes the " + mOutputName + " into given buffer, "
+                                    "it has to be DataBuffer::ReadWrite.");
+
+    if (buffer.getMemFlags() == DataBuffer::Write)
+        throw std::invalid_argument("The kernel reads the " + mInputName + " from given buffer, "
+                                    "it can't be DataBuffer::Write.");
+
+    // create the view first, the previous input stays intact if it throws
+    DataBuffer& view = buffer.createView(offset, size);
+    view.setQueueIndex(queueIndex);
+
+    deallocateInput();
+    mInput = &view;
+
+    allocateOutput(size, queueIndex);
+}
+
+void TextBuffers::setInPlace(bool inPlace)
+{
+    mInPlace = inPlace;
+}
+
+void TextBuffers::setQueueIndex(size_t idx)
+{
+    if (mInput)
+        mInput->setQueueIndex(idx);
+
+    if (mOutput)
+        mOutput->setQueueIndex(idx);
+}
+
+void TextBuffers::checkSize(size_t size) const
+{
+    if (size == 0)
+        throw std::invalid_argument("Make sure " + mInputName + " size greater than 0");
+
+    if (size % mBlockSize != 0)
+        throw std::invalid_argument(capitalize(mInputName) + " has to be padded to make full " + mCipherName + " blocks. "
+                                    "Its size has to be a multiple of " + std::to_string(mBlockSize) + ".");
+}
+
+void TextBuffers::deallocateInput()
+{
+    if (!mInput)
+        return;
+
+    if (mOutput == mInput)
+        mOutput = nullptr;
+
+    mDevice.deallocateBuffer(*mInput);
+    mInput = nullptr;
+}
+
+void TextBuffers::allocateOutput(size_t size, size_t queueIndex)
+{
+    if (mInPlace)
+    {
+        if (mOutput && mOutput != mInput)
+            mDevice.deallocateBuffer(*mOutput);
+
+        // the kernel overwrites the input with the output
+        mOutput = mInput;
+        return;
+    }
+
+    if (!mOutput || mOutput == mInput || mOutput->getArraySize<unsigned char>() != size)
+    {
+        if (mOutput && mOutput != mInput)
+            mDevice.deallocateBuffer(*mOutput);
+
+        mOutput = &mDevice.allocateBuffer<unsigned char>(size, DataBuffer::Write);
+        mOutput->setQueueIndex(queueIndex);
+    }
+}
+
+}
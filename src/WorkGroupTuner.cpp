@@ -0,0 +1,252 @@
+/*
+ * Copyright (C) 2015 Martin Preisler <martin@preisler.me>
+ *
+ * This file is part of oclcrypto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "oclcrypto/WorkGroupTuner.h"
+#include "oclcrypto/System.h"
+#include "oclcrypto/Device.h"
+#include "oclcrypto/Program.h"
+#include "oclcrypto/Kernel.h"
+#include "oclcrypto/ProgramBinaryCache.h"
+#include "oclcrypto/AES_ECB.h"
+#include "oclcrypto/AES_CTR.h"
+#include "oclcrypto/AES_GCM.h"
+#include "oclcrypto/BLOWFISH_ECB.h"
+
+#include <algorithm>
+#include <chrono>
+#include <limits>
+#include <sstream>
+
+namespace oclcrypto
+{
+
+WorkGroupTuner::WorkGroupTuner(System& system):
+    mSystem(system)
+{}
+
+void WorkGroupTuner::tune(size_t bytes)
+{
+    for (size_t i = 0; i < mSystem.getDeviceCount(); ++i)
+        tune(mSystem.getDevice(i), bytes);
+}
+
+void WorkGroupTuner::tune(Device& device, size_t bytes)
+{
+    // every cipher gets a block count divisible by all candidate sizes up to 1024,
+    // work-items taking several blocks each may limit the candidates further
+    const size_t granularity = 16 * 1024;
+    bytes = std::max<size_t>((bytes + granularity - 1) / granularity * granularity, granularity);
+
+    // contents don't matter, the ciphers take the same time for any input
+    const std::vector<unsigned char> plaintext(bytes);
+    const unsigned char key[32] = {0};
+    const unsigned char iv[16] = {0};
+
+    const std::vector<ProgramSources::Defines> variants = ProgramSources::getVariants(ProgramSources::AES);
+    for (std::vector<ProgramSources::Defines>::const_iterator it = variants.begin();
+         it != variants.end(); ++it)
+    {
+        // AES_ROUNDS is the round key count, 11, 13 or 15
+        const size_t keySize = (std::stoul(it->at("AES_ROUNDS")) - 7) * 4;
+        const size_t blockCount = bytes / 16;
+        const AES_Base::Implementation implementation =
+            it->count("AES_BITSLICED") ? AES_Base::BITSLICED :
+            it->count("AES_T_TABLES") ? AES_Base::T_TABLES : AES_Base::BYTEWISE;
+        // bitsliced kernels always take 32 blocks
+        const size_t workItemCount = blockCount /
+            (implementation == AES_Base::BITSLICED ? 32 : device.getBlocksPerWorkItem());
+
+        if (implementation == AES_Base::BITSLICED)
+        {
+            // only encryption is bitsliced
+            {
+                AES_ECB_Encrypt encrypt(mSystem, device);
+                encrypt.setKey(key, keySize);
+                encrypt.setImplementation(implementation);
+                encrypt.setPlainText(plaintext.data(), bytes);
+                tuneCipher(device, encrypt, "AES_ECB_Encrypt", ProgramSources::AES, *it, workItemCount);
+            }
+            {
+                AES_CTR_Encrypt encrypt(mSystem, device);
+                encrypt.setKey(key, keySize);
+                encrypt.setImplementation(implementation);
+                encrypt.setInitialCounter(iv);
+                encrypt.setPlainText(plaintext.data(), bytes);
+                tuneCipher(device, encrypt, "AES_CTR_Encrypt", ProgramSources::AES, *it, workItemCount);
+            }
+            continue;
+        }
+
+        {
+            AES_ECB_Encrypt encrypt(mSystem, device);
+            encrypt.setKey(key, keySize);
+            encrypt.setImplementation(implementation);
+            encrypt.setPlainText(plaintext.data(), bytes);
+            tuneCipher(device, encrypt, "AES_ECB_Encrypt", ProgramSources::AES, *it, workItemCount);
+        }
+        {
+            AES_ECB_Decrypt decrypt(mSystem, device);
+            decrypt.setKey(key, keySize);
+            decrypt.setImplementation(implementation);
+            decrypt.setCipherText(plaintext.data(), bytes);
+            tuneCipher(device, decrypt, "AES_ECB_Decrypt", ProgramSources::AES, *it, workItemCount);
+        }
+        {
+            AES_CTR_Encrypt encrypt(mSystem, device);
+            encrypt.setKey(key, keySize);
+            encrypt.setImplementation(implementation);
+            encrypt.setInitialCounter(iv);
+            encrypt.setPlainText(plaintext.data(), bytes);
+            tuneCipher(device, encrypt, "AES_CTR_Encrypt", ProgramSources::AES, *it, workItemCount);
+        }
+        {
+            AES_GCM_Encrypt encrypt(mSystem, device);
+            encrypt.setKey(key, keySize);
+            encrypt.setImplementation(implementation);
+            encrypt.setInitialVector(iv);
+            encrypt.setPlainText(plaintext.data(), bytes);
+            tuneCipher(device, encrypt, "AES_GCM_Encrypt", ProgramSources::AES, *it, workItemCount);
+        }
+    }
+
+    {
+        BLOWFISH_ECB_Encrypt encrypt(mSystem, device);
+        encrypt.setKey(key, 16);
+        encrypt.setPlainText(plaintext.data(), bytes);
+        tuneCipher(device, encrypt, "BLOWFISH_ECB_Encrypt", ProgramSources::BLOWFISH,
+                   ProgramSources::Defines(), bytes / 8 / device.getBlocksPerWorkItem());
+    }
+
+    ProgramBinaryCache* cache = mSystem.getProgramBinaryCache();
+    if (cache)
+        store(device, *cache);
+}
+
+std::vector<size_t> WorkGroupTuner::getCandidates(size_t workGroupSize, size_t preferredMultiple)
+{
+    std::vector<size_t> ret;
+    ret.push_back(0);
+
+    // nobody benefits from larger groups, the ciphers don't share anything within them
+    workGroupSize = std::min<size_t>(workGroupSize, 1024);
+
+    for (size_t size = std::max<size_t>(preferredMultiple, 1); size <= workGroupSize; size *= 2)
+        ret.push_back(size);
+
+    return ret;
+}
+
+bool WorkGroupTuner::load(Device& device, const ProgramBinaryCache& cache)
+{
+    std::vector<unsigned char> entry;
+    if (!cache.load(makeCacheKey(device), entry))
+        return false;
+
+    // one "kernel\tvariant\tsize" line per kernel
+    std::istringstream stream(std::string(entry.begin(), entry.end()));
+    Device::LocalWorkSizeMap sizes;
+
+    std::string line;
+    while (std::getline(stream, line))
+    {
+        const size_t first = line.find('\t');
+        const size_t second = first == std::string::npos ? first : line.find('\t', first + 1);
+        if (second == std::string::npos)
+            return false;
+
+        const std::string size = line.substr(second + 1);
+        if (size.empty() || size.find_first_not_of("0123456789") != std::string::npos)
+            return false;
+
+        sizes[std::make_pair(line.substr(0, first), line.substr(first + 1, second - first - 1))] =
+            std::stoul(size);
+    }
+
+    device.setTunedLocalWorkSizes(sizes);
+    return true;
+}
+
+bool WorkGroupTuner::store(const Device& device, const ProgramBinaryCache& cache)
+{
+    const Device::LocalWorkSizeMap sizes = device.getTunedLocalWorkSizes();
+
+    std::ostringstream stream;
+    for (Device::LocalWorkSizeMap::const_iterator it = sizes.begin(); it != sizes.end(); ++it)
+        stream << it->first.first << '\t' << it->first.second << '\t' << it->second << '\n';
+
+    const std::string entry = stream.str();
+    return cache.store(makeCacheKey(device), std::vector<unsigned char>(entry.begin(), entry.end()));
+}
+
+template<typename Cipher>
+void WorkGroupTuner::tuneCipher(Device& device, Cipher& cipher, const std::string& kernelName,
+                                ProgramSources::ProgramType type, const ProgramSources::Defines& defines,
+                                size_t workItemCount)
+{
+    Program& program = mSystem.getProgramFromCache(device, type, defines);
+
+    size_t workGroupSize = 0;
+    size_t preferredMultiple = 1;
+    {
+        ScopedKernel kernel(program.createKernel(kernelName));
+        workGroupSize = kernel->getWorkGroupSize();
+        preferredMultiple = kernel->getPreferredWorkGroupSizeMultiple();
+    }
+
+    const std::vector<size_t> candidates = getCandidates(std::min(workGroupSize, workItemCount), preferredMultiple);
+
+    // the first run builds the kernel and warms up the driver, it isn't measured
+    cipher.execute(0).wait();
+
+    size_t bestSize = 0;
+    long long bestTime = std::numeric_limits<long long>::max();
+
+    for (std::vector<size_t>::const_iterator it = candidates.begin(); it != candidates.end(); ++it)
+    {
+        // best of 3 filters out hiccups caused by anything else running on the device
+        for (int i = 0; i < 3; ++i)
+        {
+            const std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+            cipher.execute(*it).wait();
+            const long long elapsed =
+                std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start).count();
+
+            if (elapsed < bestTime)
+            {
+                bestTime = elapsed;
+                bestSize = *it;
+            }
+        }
+    }
+
+    device.setTunedLocalWorkSize(kernelName, program.getVariant(), bestSize);
+}
+
+std::string WorkGroupTuner::makeCacheKey(const Device& device)
+{
+    return ProgramBinaryCache::makeKey(device, "", "oclcrypto work-group sizes v1");
+}
+
+}
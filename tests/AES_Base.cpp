@@ -359,4 +359,41 @@ BOOST_AUTO_TEST_CASE(KeySchedule256)
     }
 }
 
+BOOST_AUTO_TEST_CASE(InverseKeySchedule)
+{
+    // FIPS 197, appendix C.1, the ik_sch values of the equivalent inverse cipher,
+    // listed there from the last round key down
+
+    const unsigned char key[] =
+    {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+    };
+    const unsigned char expected_schedule[] =
+    {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07, 0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+        0x8c, 0x56, 0xdf, 0xf0, 0x82, 0x5d, 0xd3, 0xf9, 0x80, 0x5a, 0xd3, 0xfc, 0x86, 0x59, 0xd7, 0xfd,
+        0xa0, 0xdb, 0x02, 0x99, 0x22, 0x86, 0xd1, 0x60, 0xa2, 0xdc, 0x02, 0x9c, 0x24, 0x85, 0xd5, 0x61,
+        0xc7, 0xc6, 0xe3, 0x91, 0xe5, 0x40, 0x32, 0xf1, 0x47, 0x9c, 0x30, 0x6d, 0x63, 0x19, 0xe5, 0x0c,
+        0xa8, 0xa2, 0xf5, 0x04, 0x4d, 0xe2, 0xc7, 0xf5, 0x0a, 0x7e, 0xf7, 0x98, 0x69, 0x67, 0x12, 0x94,
+        0x2e, 0xc4, 0x10, 0x27, 0x63, 0x26, 0xd7, 0xd2, 0x69, 0x58, 0x20, 0x4a, 0x00, 0x3f, 0x32, 0xde,
+        0x72, 0xe3, 0x09, 0x8d, 0x11, 0xc5, 0xde, 0x5f, 0x78, 0x9d, 0xfe, 0x15, 0x78, 0xa2, 0xcc, 0xcb,
+        0x8d, 0x82, 0xfc, 0x74, 0x9c, 0x47, 0x22, 0x2b, 0xe4, 0xda, 0xdc, 0x3e, 0x9c, 0x78, 0x10, 0xf5,
+        0x13, 0x62, 0xa4, 0x63, 0x8f, 0x25, 0x86, 0x48, 0x6b, 0xff, 0x5a, 0x76, 0xf7, 0x87, 0x4a, 0x83,
+        0x13, 0xaa, 0x29, 0xbe, 0x9c, 0x8f, 0xaf, 0xf6, 0xf7, 0x70, 0xf5, 0x80, 0x00, 0xf7, 0xbf, 0x03,
+        0x13, 0x11, 0x1d, 0x7f, 0xe3, 0x94, 0x4a, 0x17, 0xf3, 0x07, 0xa7, 0x8b, 0x4d, 0x2b, 0x30, 0xc5
+    };
+
+    unsigned short rounds = 0;
+    std::unique_ptr<unsigned char[]> output(oclcrypto::AES_Base::expandKeyRounds(key, 16, rounds));
+    oclcrypto::AES_Base::invertKeyRounds(output.get(), rounds);
+
+    BOOST_CHECK_EQUAL(rounds, 11);
+
+    for (size_t i = 0; i < rounds * 16; ++i)
+    {
+        BOOST_CHECK_EQUAL(expected_schedule[i], output.get()[i]);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
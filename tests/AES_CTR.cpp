@@ -24,11 +24,14 @@
  */
 
 #include <oclcrypto/AES_CTR.h>
+#include <oclcrypto/AES_ECB.h>
 #include <oclcrypto/System.h>
 #include <oclcrypto/DataBuffer.h>
 
 #include <boost/test/unit_test.hpp>
 
+#include <vector>
+
 struct AES_CTR_Fixture
 {
     AES_CTR_Fixture():
@@ -79,20 +82,172 @@ BOOST_AUTO_TEST_CASE(Encrypt128)
         {
             oclcrypto::Device& device = system.getDevice(i);
 
+            const oclcrypto::AES_Base::Implementation implementations[] =
+            {
+                oclcrypto::AES_Base::BYTEWISE,
+                oclcrypto::AES_Base::T_TABLES,
+                oclcrypto::AES_Base::BITSLICED
+            };
+
+            for (int k = 0; k < 3; ++k)
+            {
+                oclcrypto::AES_CTR_Encrypt encrypt(system, device);
+                encrypt.setImplementation(implementations[k]);
+                encrypt.setKey(key, 16);
+                encrypt.setInitialCounter(initial_counter);
+                encrypt.setPlainText(plaintext, 16 * 4);
+
+                encrypt.execute(1);
+
+                {
+                    auto data = encrypt.getCipherText()->lockRead<unsigned char>();
+                    for (size_t j = 0; j < data.size(); ++j)
+                        BOOST_CHECK_EQUAL(data[j], expected_ciphertext[j]);
+                }
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(CounterCarry)
+{
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+
+    const unsigned char key[] =
+    {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+    };
+
+    // the low 64 bits overflow at the second block
+    const unsigned char initial_counter[] =
+    {
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff
+    };
+
+    // plus an offset of 2^64 - 1 that gives the all ones counter
+    const unsigned char high_counter[] =
+    {
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+    };
+
+    const unsigned char counters[] =
+    {
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+        0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff, 0xff,
+        0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00
+    };
+
+    const std::vector<unsigned char> plaintext(32, 0);
+
+    for (size_t i = 0; i < system.getDeviceCount(); ++i)
+    {
+        oclcrypto::Device& device = system.getDevice(i);
+
+        // with a zero plaintext the ciphertext is the encrypted counter blocks
+        oclcrypto::AES_ECB_Encrypt keystream(system, device);
+        keystream.setKey(key, 16);
+        keystream.setPlainText(counters, sizeof(counters));
+        keystream.execute(1);
+        auto expected = keystream.getCipherText()->lockRead<unsigned char>();
+
+        const oclcrypto::AES_Base::Implementation implementations[] =
+        {
+            oclcrypto::AES_Base::BYTEWISE,
+            oclcrypto::AES_Base::T_TABLES,
+            oclcrypto::AES_Base::BITSLICED
+        };
+
+        for (int k = 0; k < 3; ++k)
+        {
             oclcrypto::AES_CTR_Encrypt encrypt(system, device);
+            encrypt.setImplementation(implementations[k]);
             encrypt.setKey(key, 16);
             encrypt.setInitialCounter(initial_counter);
-            encrypt.setPlainText(plaintext, 16 * 4);
+            encrypt.setPlainText(plaintext.data(), plaintext.size());
+            encrypt.execute(1);
+
+            {
+                auto data = encrypt.getCipherText()->lockRead<unsigned char>();
+                BOOST_CHECK_EQUAL_COLLECTIONS(data.begin(), data.end(), expected.begin(), expected.begin() + 32);
+            }
 
+            // from the all ones counter to zero
+            encrypt.setInitialCounter(high_counter);
+            encrypt.setBlockOffset(0xffffffffffffffffull);
+            encrypt.setPlainText(plaintext.data(), plaintext.size());
             encrypt.execute(1);
 
             {
                 auto data = encrypt.getCipherText()->lockRead<unsigned char>();
-                for (size_t j = 0; j < data.size(); ++j)
-                    BOOST_CHECK_EQUAL(data[j], expected_ciphertext[j]);
+                BOOST_CHECK_EQUAL_COLLECTIONS(data.begin(), data.end(), expected.begin() + 32, expected.end());
             }
         }
     }
 }
 
+BOOST_AUTO_TEST_CASE(Chunks)
+{
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+
+    // 261 blocks, split into chunks of 100, 61 and 100
+    std::vector<unsigned char> plaintext(4176);
+    for (size_t i = 0; i < plaintext.size(); ++i)
+        plaintext[i] = static_cast<unsigned char>(i * 17 + i / 256);
+
+    const unsigned char key[] =
+    {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+    };
+
+    const unsigned char initial_counter[] =
+    {
+        0xf0, 0xf1, 0xf2, 0xf3, 0xf4, 0xf5, 0xf6, 0xf7,
+        0xf8, 0xf9, 0xfa, 0xfb, 0xfc, 0xfd, 0xfe, 0xff
+    };
+
+    const size_t chunks[] = {100, 61, 100};
+
+    for (size_t i = 0; i < system.getDeviceCount(); ++i)
+    {
+        oclcrypto::Device& device = system.getDevice(i);
+
+        std::vector<unsigned char> whole;
+        {
+            oclcrypto::AES_CTR_Encrypt encrypt(system, device);
+            encrypt.setKey(key, 16);
+            encrypt.setInitialCounter(initial_counter);
+            encrypt.setPlainText(plaintext.data(), plaintext.size());
+            encrypt.execute();
+
+            auto data = encrypt.getCipherText()->lockRead<unsigned char>();
+            whole.assign(data.begin(), data.end());
+        }
+
+        // each chunk on its own cipher as if launched independently
+        std::vector<unsigned char> chunked;
+        size_t offset = 0;
+        for (int j = 0; j < 3; ++j)
+        {
+            oclcrypto::AES_CTR_Encrypt encrypt(system, device);
+            encrypt.setKey(key, 16);
+            encrypt.setInitialCounter(initial_counter);
+            encrypt.setBlockOffset(offset);
+            BOOST_CHECK_EQUAL(encrypt.getBlockOffset(), offset);
+            encrypt.setPlainText(plaintext.data() + offset * 16, chunks[j] * 16);
+            encrypt.execute();
+
+            auto data = encrypt.getCipherText()->lockRead<unsigned char>();
+            chunked.insert(chunked.end(), data.begin(), data.end());
+            offset += chunks[j];
+        }
+
+        BOOST_CHECK(chunked == whole);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -25,10 +25,18 @@
 
 #include <oclcrypto/AES_ECB.h>
 #include <oclcrypto/System.h>
+#include <oclcrypto/Device.h>
 #include <oclcrypto/DataBuffer.h>
+#include <oclcrypto/Program.h>
 
 #include <boost/test/unit_test.hpp>
 
+#include <algorithm>
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <vector>
+
 struct AES_ECB_Fixture
 {
     AES_ECB_Fixture():
@@ -700,4 +708,561 @@ BOOST_AUTO_TEST_CASE(EncryptDecryptRoundTrip256)
     }
 }
 
+BOOST_AUTO_TEST_CASE(EncryptWrapped128)
+{
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+
+    // test vector taken from FIPS 197, example C.1
+
+    const unsigned char plaintext[] =
+    {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+        0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+    };
+
+    const unsigned char key[] =
+    {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+    };
+
+    const unsigned char expected_ciphertext[] =
+    {
+        0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+        0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+    };
+
+    for (size_t i = 0; i < system.getDeviceCount(); ++i)
+    {
+        oclcrypto::Device& device = system.getDevice(i);
+
+        // over-allocate and align the plaintext so that it can be wrapped
+        std::vector<unsigned char> storage(device.getMemBaseAddrAlign() + 16);
+        void* aligned = storage.data();
+        size_t space = storage.size();
+        BOOST_REQUIRE(std::align(device.getMemBaseAddrAlign(), 16, aligned, space));
+        unsigned char* wrapped = static_cast<unsigned char*>(aligned);
+        std::copy(plaintext, plaintext + 16, wrapped);
+
+        oclcrypto::AES_ECB_Encrypt encrypt(system, device);
+        encrypt.setKey(key, 16);
+        BOOST_CHECK(encrypt.wrapPlainText(wrapped, 16));
+
+        encrypt.execute(1);
+
+        {
+            auto data = encrypt.getCipherText()->lockRead<unsigned char>();
+            for (size_t j = 0; j < data.size(); ++j)
+                BOOST_CHECK_EQUAL(data[j], expected_ciphertext[j]);
+        }
+
+        // copying plaintext afterwards must not touch the wrapped memory
+        const unsigned char zeros[16] = {0};
+        encrypt.setPlainText(zeros, 16);
+        for (size_t j = 0; j < 16; ++j)
+            BOOST_CHECK_EQUAL(wrapped[j], plaintext[j]);
+
+        // misaligned memory has to fall back to copying
+        if (device.getMemBaseAddrAlign() > 1)
+            BOOST_CHECK(!encrypt.wrapPlainText(wrapped + 1, 16));
+    }
+}
+
+BOOST_AUTO_TEST_CASE(EncryptView128)
+{
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+
+    // test vector taken from FIPS 197, example C.1
+
+    const unsigned char plaintext[] =
+    {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+        0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+    };
+
+    const unsigned char key[] =
+    {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+    };
+
+    const unsigned char expected_ciphertext[] =
+    {
+        0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+        0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+    };
+
+    for (size_t i = 0; i < system.getDeviceCount(); ++i)
+    {
+        oclcrypto::Device& device = system.getDevice(i);
+
+        // the second message of the staging buffer is the one we encrypt
+        const size_t offset = std::max<size_t>(device.getMemBaseAddrAlign(), 16);
+        oclcrypto::DataBuffer& staging = device.allocateBuffer<unsigned char>(2 * offset, oclcrypto::DataBuffer::Read);
+        {
+            auto data = staging.lockWrite<unsigned char>(offset, 16);
+            for (size_t j = 0; j < 16; ++j)
+                data[j] = plaintext[j];
+        }
+
+        {
+            oclcrypto::AES_ECB_Encrypt encrypt(system, device);
+            encrypt.setKey(key, 16);
+            encrypt.setPlainTextView(staging, offset, 16);
+            BOOST_CHECK_EQUAL(staging.getViewCount(), 1);
+
+            encrypt.execute(1);
+
+            {
+                auto data = encrypt.getCipherText()->lockRead<unsigned char>();
+                for (size_t j = 0; j < data.size(); ++j)
+                    BOOST_CHECK_EQUAL(data[j], expected_ciphertext[j]);
+            }
+
+            // the staging buffer can't go away while the cipher uses it
+            BOOST_CHECK_THROW(device.deallocateBuffer(staging), std::runtime_error);
+        }
+
+        BOOST_CHECK_EQUAL(staging.getViewCount(), 0);
+        device.deallocateBuffer(staging);
+
+        // the kernel can't read the plaintext from a write only buffer
+        oclcrypto::DataBuffer& writeOnly = device.allocateBuffer<unsigned char>(16, oclcrypto::DataBuffer::Write);
+        {
+            oclcrypto::AES_ECB_Encrypt encrypt(system, device);
+            BOOST_CHECK_THROW(encrypt.setPlainTextView(writeOnly, 0, 16), std::invalid_argument);
+            BOOST_CHECK_EQUAL(writeOnly.getViewCount(), 0);
+        }
+        device.deallocateBuffer(writeOnly);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(InPlace128)
+{
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+
+    // test vector taken from FIPS 197, example C.1
+
+    const unsigned char plaintext[] =
+    {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+        0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+    };
+
+    const unsigned char key[] =
+    {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+    };
+
+    const unsigned char expected_ciphertext[] =
+    {
+        0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+        0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+    };
+
+    for (size_t i = 0; i < system.getDeviceCount(); ++i)
+    {
+        oclcrypto::Device& device = system.getDevice(i);
+
+        oclcrypto::AES_ECB_Encrypt encrypt(system, device);
+        encrypt.setKey(key, 16);
+        encrypt.setInPlace(true);
+        BOOST_CHECK(encrypt.isInPlace());
+
+        // only one buffer is allocated for both plaintext and ciphertext
+        const size_t liveBuffers = device.getLiveBufferCount();
+        encrypt.setPlainText(plaintext, 16);
+        BOOST_CHECK_EQUAL(device.getLiveBufferCount(), liveBuffers + 1);
+        BOOST_CHECK_EQUAL(encrypt.getCipherText()->getMemFlags(), oclcrypto::DataBuffer::ReadWrite);
+
+        encrypt.execute(1);
+
+        {
+            auto data = encrypt.getCipherText()->lockRead<unsigned char>();
+            BOOST_CHECK_EQUAL_COLLECTIONS(data.begin(), data.end(), expected_ciphertext, expected_ciphertext + 16);
+        }
+
+        oclcrypto::AES_ECB_Decrypt decrypt(system, device);
+        decrypt.setKey(key, 16);
+        decrypt.setInPlace(true);
+        decrypt.setCipherText(expected_ciphertext, 16);
+        decrypt.execute(1);
+
+        {
+            auto data = decrypt.getPlainText()->lockRead<unsigned char>();
+            BOOST_CHECK_EQUAL_COLLECTIONS(data.begin(), data.end(), plaintext, plaintext + 16);
+        }
+
+        // switching back allocates a separate ciphertext buffer again
+        const size_t inPlaceBuffers = device.getLiveBufferCount();
+        encrypt.setInPlace(false);
+        encrypt.setPlainText(plaintext, 16);
+        BOOST_CHECK_EQUAL(device.getLiveBufferCount(), inPlaceBuffers + 1);
+        encrypt.execute(1);
+
+        {
+            auto data = encrypt.getCipherText()->lockRead<unsigned char>();
+            BOOST_CHECK_EQUAL_COLLECTIONS(data.begin(), data.end(), expected_ciphertext, expected_ciphertext + 16);
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(KernelReuse)
+{
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+
+    // test vectors taken from FIPS 197, examples C.1 and C.3
+
+    const unsigned char plaintext[] =
+    {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+        0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+    };
+
+    const unsigned char key[] =
+    {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f,
+        0x10, 0x11, 0x12, 0x13, 0x14, 0x15, 0x16, 0x17,
+        0x18, 0x19, 0x1a, 0x1b, 0x1c, 0x1d, 0x1e, 0x1f
+    };
+
+    const unsigned char expected_ciphertext128[] =
+    {
+        0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+        0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+    };
+
+    const unsigned char expected_ciphertext256[] =
+    {
+        0x8e, 0xa2, 0xb7, 0xca, 0x51, 0x67, 0x45, 0xbf,
+        0xea, 0xfc, 0x49, 0x90, 0x4b, 0x49, 0x60, 0x89
+    };
+
+    for (size_t i = 0; i < system.getDeviceCount(); ++i)
+    {
+        oclcrypto::Device& device = system.getDevice(i);
+
+        // ciphers use the byte-wise implementation by default
+        oclcrypto::ProgramSources::Defines defines128;
+        defines128["AES_ROUNDS"] = "11";
+        oclcrypto::ProgramSources::Defines defines256;
+        defines256["AES_ROUNDS"] = "15";
+
+        oclcrypto::Program& program = system.getProgramFromCache(device, oclcrypto::ProgramSources::AES, defines128);
+        oclcrypto::Program& program256 = system.getProgramFromCache(device, oclcrypto::ProgramSources::AES, defines256);
+        BOOST_CHECK_NE(&program, &program256);
+
+        const size_t kernelCount = program.getKernelCount();
+        const size_t kernelCount256 = program256.getKernelCount();
+
+        oclcrypto::AES_ECB_Encrypt encrypt(system, device);
+        encrypt.setKey(key, 16);
+
+        for (int j = 0; j < 3; ++j)
+        {
+            encrypt.setPlainText(plaintext, 16);
+            encrypt.execute(1);
+
+            auto data = encrypt.getCipherText()->lockRead<unsigned char>();
+            BOOST_CHECK_EQUAL_COLLECTIONS(data.begin(), data.end(), expected_ciphertext128, expected_ciphertext128 + 16);
+        }
+
+        // one kernel for all the executes
+        BOOST_CHECK_EQUAL(program.getKernelCount(), kernelCount + 1);
+
+        // changing the key size has to switch to the 256bit variant and rebind
+        // both the key and the rounds
+        encrypt.setKey(key, 32);
+        encrypt.execute(1);
+
+        {
+            auto data = encrypt.getCipherText()->lockRead<unsigned char>();
+            BOOST_CHECK_EQUAL_COLLECTIONS(data.begin(), data.end(), expected_ciphertext256, expected_ciphertext256 + 16);
+        }
+
+        BOOST_CHECK_EQUAL(program.getKernelCount(), kernelCount);
+        BOOST_CHECK_EQUAL(program256.getKernelCount(), kernelCount256 + 1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MultipleQueues)
+{
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+
+    // test vector taken from FIPS 197, example C.1
+
+    const unsigned char plaintext[] =
+    {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+        0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+    };
+
+    const unsigned char key[] =
+    {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+    };
+
+    const unsigned char expected_ciphertext[] =
+    {
+        0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+        0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+    };
+
+    for (size_t i = 0; i < system.getDeviceCount(); ++i)
+    {
+        oclcrypto::Device& device = system.getDevice(i);
+
+        BOOST_CHECK_THROW(device.setQueueCount(0), std::invalid_argument);
+        device.setQueueCount(3);
+        BOOST_REQUIRE_EQUAL(device.getQueueCount(), 3);
+
+        std::vector<std::unique_ptr<oclcrypto::AES_ECB_Encrypt>> ciphers;
+        for (int j = 0; j < 3; ++j)
+            ciphers.emplace_back(new oclcrypto::AES_ECB_Encrypt(system, device));
+
+        // consecutive ciphers get consecutive queues
+        BOOST_CHECK_NE(ciphers[0]->getQueueIndex() % 3, ciphers[1]->getQueueIndex() % 3);
+        BOOST_CHECK_NE(ciphers[1]->getQueueIndex() % 3, ciphers[2]->getQueueIndex() % 3);
+        BOOST_CHECK_NE(ciphers[0]->getQueueIndex() % 3, ciphers[2]->getQueueIndex() % 3);
+
+        // everything is enqueued before anything is read back
+        for (int j = 0; j < 3; ++j)
+        {
+            ciphers[j]->setKey(key, 16);
+            ciphers[j]->setPlainText(plaintext, 16);
+            ciphers[j]->execute(1);
+        }
+
+        for (int j = 0; j < 3; ++j)
+        {
+            BOOST_CHECK_EQUAL(ciphers[j]->getCipherText()->getQueueIndex(), ciphers[j]->getQueueIndex());
+
+            auto data = ciphers[j]->getCipherText()->lockRead<unsigned char>();
+            BOOST_CHECK_EQUAL_COLLECTIONS(data.begin(), data.end(), expected_ciphertext, expected_ciphertext + 16);
+        }
+
+        // moving a cipher to another queue keeps its buffers consistent
+        ciphers[0]->setQueueIndex(ciphers[1]->getQueueIndex());
+        ciphers[0]->setPlainText(plaintext, 16);
+        ciphers[0]->execute(1);
+
+        {
+            BOOST_CHECK_EQUAL(ciphers[0]->getCipherText()->getQueueIndex(), ciphers[1]->getQueueIndex());
+
+            auto data = ciphers[0]->getCipherText()->lockRead<unsigned char>();
+            BOOST_CHECK_EQUAL_COLLECTIONS(data.begin(), data.end(), expected_ciphertext, expected_ciphertext + 16);
+        }
+
+        ciphers.clear();
+        device.setQueueCount(1);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(ConcurrentEncrypt)
+{
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+
+    // test vector taken from FIPS 197, example C.1
+
+    const unsigned char plaintext[] =
+    {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+        0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+    };
+
+    const unsigned char key[] =
+    {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+    };
+
+    const unsigned char expected_ciphertext[] =
+    {
+        0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+        0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+    };
+
+    for (size_t i = 0; i < system.getDeviceCount(); ++i)
+    {
+        oclcrypto::Device& device = system.getDevice(i);
+        const size_t liveBuffers = device.getLiveBufferCount();
+
+        // Boost.Test assertions aren't thread-safe, the threads only count failures
+        std::atomic<int> failures(0);
+        std::vector<std::thread> threads;
+
+        for (int t = 0; t < 8; ++t)
+        {
+            threads.emplace_back([&]()
+            {
+                try
+                {
+                    for (int j = 0; j < 16; ++j)
+                    {
+                        // a new cipher every few iterations exercises kernel and buffer creation
+                        oclcrypto::AES_ECB_Encrypt encrypt(system, device);
+                        encrypt.setKey(key, 16);
+
+                        for (int k = 0; k < 4; ++k)
+                        {
+                            encrypt.setPlainText(plaintext, 16);
+                            encrypt.execute(1);
+
+                            auto data = encrypt.getCipherText()->lockRead<unsigned char>();
+                            if (!std::equal(data.begin(), data.end(), expected_ciphertext))
+                                ++failures;
+                        }
+                    }
+                }
+                catch (...)
+                {
+                    ++failures;
+                }
+            });
+        }
+
+        for (size_t t = 0; t < threads.size(); ++t)
+            threads[t].join();
+
+        BOOST_CHECK_EQUAL(failures.load(), 0);
+        BOOST_CHECK_EQUAL(device.getLiveBufferCount(), liveBuffers);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Implementations)
+{
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+
+    // 261 blocks, the last bitsliced work-item only has 5 of its 32
+    std::vector<unsigned char> plaintext(4176);
+    for (size_t i = 0; i < plaintext.size(); ++i)
+        plaintext[i] = static_cast<unsigned char>(i * 31 + i / 256);
+
+    std::vector<unsigned char> key(32);
+    for (size_t i = 0; i < key.size(); ++i)
+        key[i] = static_cast<unsigned char>(i * 7 + 3);
+
+    const oclcrypto::AES_Base::Implementation implementations[] =
+    {
+        oclcrypto::AES_Base::BYTEWISE,
+        oclcrypto::AES_Base::T_TABLES,
+        oclcrypto::AES_Base::BITSLICED
+    };
+
+    for (size_t i = 0; i < system.getDeviceCount(); ++i)
+    {
+        oclcrypto::Device& device = system.getDevice(i);
+
+        for (size_t keySize = 16; keySize <= 32; keySize += 8)
+        {
+            std::vector<unsigned char> ciphertexts[3];
+
+            for (int j = 0; j < 3; ++j)
+            {
+                oclcrypto::AES_ECB_Encrypt encrypt(system, device);
+                encrypt.setImplementation(implementations[j]);
+                BOOST_CHECK_EQUAL(encrypt.getImplementation(), implementations[j]);
+                encrypt.setKey(key.data(), keySize);
+                encrypt.setPlainText(plaintext.data(), plaintext.size());
+                // several work-items per group share the work of filling the tables
+                encrypt.execute(64);
+
+                auto data = encrypt.getCipherText()->lockRead<unsigned char>();
+                ciphertexts[j].assign(data.begin(), data.end());
+            }
+
+            BOOST_CHECK(ciphertexts[0] == ciphertexts[1]);
+            BOOST_CHECK(ciphertexts[0] == ciphertexts[2]);
+
+            for (int j = 0; j < 2; ++j)
+            {
+                oclcrypto::AES_ECB_Decrypt decrypt(system, device);
+                decrypt.setImplementation(implementations[j]);
+                decrypt.setKey(key.data(), keySize);
+                decrypt.setCipherText(ciphertexts[0].data(), ciphertexts[0].size());
+                decrypt.execute(64);
+
+                auto data = decrypt.getPlainText()->lockRead<unsigned char>();
+                BOOST_CHECK_EQUAL_COLLECTIONS(data.begin(), data.end(), plaintext.begin(), plaintext.end());
+            }
+
+            {
+                // decryption isn't bitsliced
+                oclcrypto::AES_ECB_Decrypt decrypt(system, device);
+                decrypt.setImplementation(oclcrypto::AES_Base::BITSLICED);
+                decrypt.setKey(key.data(), keySize);
+                decrypt.setCipherText(ciphertexts[0].data(), ciphertexts[0].size());
+                BOOST_CHECK_THROW(decrypt.execute(64), std::invalid_argument);
+            }
+        }
+    }
+}
+
+BOOST_AUTO_TEST_CASE(BlocksPerWorkItem)
+{
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+
+    // 261 blocks, no number of blocks per work-item divides it
+    std::vector<unsigned char> plaintext(4176);
+    for (size_t i = 0; i < plaintext.size(); ++i)
+        plaintext[i] = static_cast<unsigned char>(i * 13 + i / 256);
+
+    const unsigned char key[16] =
+    {
+        0x2b, 0x7e, 0x15, 0x16, 0x28, 0xae, 0xd2, 0xa6,
+        0xab, 0xf7, 0x15, 0x88, 0x09, 0xcf, 0x4f, 0x3c
+    };
+
+    for (size_t i = 0; i < system.getDeviceCount(); ++i)
+    {
+        oclcrypto::Device& device = system.getDevice(i);
+        const size_t original = device.getBlocksPerWorkItem();
+        BOOST_CHECK_GE(original, 1);
+        BOOST_CHECK_LE(original, oclcrypto::Device::MaxBlocksPerWorkItem);
+
+        BOOST_CHECK_THROW(device.setBlocksPerWorkItem(0), std::invalid_argument);
+        BOOST_CHECK_THROW(device.setBlocksPerWorkItem(oclcrypto::Device::MaxBlocksPerWorkItem + 1), std::invalid_argument);
+
+        std::vector<unsigned char> reference;
+        const size_t counts[] = {1, 3, oclcrypto::Device::MaxBlocksPerWorkItem};
+
+        // one cipher for all counts, it has to switch programs on the fly
+        oclcrypto::AES_ECB_Encrypt encrypt(system, device);
+        encrypt.setKey(key, 16);
+        oclcrypto::AES_ECB_Decrypt decrypt(system, device);
+        decrypt.setKey(key, 16);
+
+        for (int j = 0; j < 3; ++j)
+        {
+            device.setBlocksPerWorkItem(counts[j]);
+            BOOST_CHECK_EQUAL(device.getBlocksPerWorkItem(), counts[j]);
+
+            encrypt.setPlainText(plaintext.data(), plaintext.size());
+            encrypt.execute(64);
+
+            std::vector<unsigned char> ciphertext;
+            {
+                auto data = encrypt.getCipherText()->lockRead<unsigned char>();
+                ciphertext.assign(data.begin(), data.end());
+            }
+
+            if (j == 0)
+                reference = ciphertext;
+            else
+                BOOST_CHECK(ciphertext == reference);
+
+            decrypt.setCipherText(ciphertext.data(), ciphertext.size());
+            decrypt.execute(64);
+
+            auto data = decrypt.getPlainText()->lockRead<unsigned char>();
+            BOOST_CHECK_EQUAL_COLLECTIONS(data.begin(), data.end(), plaintext.begin(), plaintext.end());
+        }
+
+        device.setBlocksPerWorkItem(original);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -140,4 +140,27 @@ BOOST_AUTO_TEST_CASE(Encrypt128)
     }
 }
 
+BOOST_AUTO_TEST_CASE(TooManyBlocks)
+{
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+
+    // the sizes below don't fit 32bit size_t
+    if (sizeof(size_t) <= 4)
+        return;
+
+    const unsigned char plaintext[16] = {0};
+    // the size is rejected before the plaintext is read
+    const size_t tooLong = (oclcrypto::AES_GCM_Encrypt::MaxBlockCount + 1) * 16;
+
+    for (size_t i = 0; i < system.getDeviceCount(); ++i)
+    {
+        oclcrypto::Device& device = system.getDevice(i);
+
+        oclcrypto::AES_GCM_Encrypt encrypt(system, device);
+        BOOST_CHECK_THROW(encrypt.setPlainText(plaintext, tooLong), std::invalid_argument);
+        BOOST_CHECK_THROW(encrypt.wrapPlainText(plaintext, tooLong), std::invalid_argument);
+        BOOST_CHECK(encrypt.getCipherText() == nullptr);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -24,8 +24,13 @@
  */
 
 #include <oclcrypto/System.h>
+#include <oclcrypto/Device.h>
+#include <oclcrypto/Program.h>
 #include <boost/test/unit_test.hpp>
 
+#include <string>
+#include <vector>
+
 BOOST_AUTO_TEST_SUITE(InitDeinit)
 
 BOOST_AUTO_TEST_CASE(InitWithCPUs)
@@ -42,4 +47,108 @@ BOOST_AUTO_TEST_CASE(InitWithoutCPUs)
     BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
 }
 
+BOOST_AUTO_TEST_CASE(PrebuildPrograms)
+{
+    oclcrypto::System system(true, true);
+
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+    system.warmUp();
+
+    for (size_t i = 0; i < system.getDeviceCount(); ++i)
+    {
+        oclcrypto::Device& device = system.getDevice(i);
+        const std::vector<oclcrypto::ProgramSources::Defines> variants =
+            oclcrypto::ProgramSources::getVariants(oclcrypto::ProgramSources::AES);
+
+        // 3 key sizes, each byte-wise, with T-tables and bitsliced
+        BOOST_REQUIRE_EQUAL(variants.size(), 9);
+        oclcrypto::Program& aes128 = system.getProgramFromCache(device, oclcrypto::ProgramSources::AES, variants[0]);
+        oclcrypto::Program& aes256 = system.getProgramFromCache(device, oclcrypto::ProgramSources::AES, variants[6]);
+        oclcrypto::Program& blowfish = system.getProgramFromCache(device, oclcrypto::ProgramSources::BLOWFISH);
+
+        BOOST_CHECK_NE(&aes128, &aes256);
+        BOOST_CHECK_NE(&aes128, &blowfish);
+        BOOST_CHECK_NE(aes128.getBuildOptions().find("-D AES_ROUNDS=11"), std::string::npos);
+        // the cache must hand out the prebuilt programs, not build new ones
+        BOOST_CHECK_EQUAL(&aes128, &system.getProgramFromCache(device, oclcrypto::ProgramSources::AES, variants[0]));
+    }
+
+    // warming up again is a no-op
+    system.warmUp();
+}
+
+BOOST_AUTO_TEST_CASE(ProgramDefines)
+{
+    oclcrypto::ProgramSources::Defines defines;
+    BOOST_CHECK_EQUAL(oclcrypto::ProgramSources::getBuildOptions(defines), "");
+
+    defines["B"] = "2";
+    defines["A"] = "";
+    // sorted by name so that equal sets give equal options
+    BOOST_CHECK_EQUAL(oclcrypto::ProgramSources::getBuildOptions(defines), "-D A -D B=2");
+}
+
+BOOST_AUTO_TEST_CASE(WarmUpWithoutPrebuild)
+{
+    oclcrypto::System system(true);
+
+    system.warmUp();
+    oclcrypto::Device& device = system.getDevice(0);
+    BOOST_CHECK(system.getProgramFromCache(device, oclcrypto::ProgramSources::AES).getCLProgram() != nullptr);
+}
+
+BOOST_AUTO_TEST_CASE(DestroyWhilePrebuilding)
+{
+    // must not crash or leak when the builds are still running
+    oclcrypto::System system(true, true);
+}
+
+BOOST_AUTO_TEST_CASE(BestDevice)
+{
+    oclcrypto::System system(true);
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+
+    system.setPreferredDevice("");
+    oclcrypto::Device& best = system.getBestDevice();
+
+    for (size_t i = 0; i < system.getDeviceCount(); ++i)
+    {
+        oclcrypto::Device& device = system.getDevice(i);
+        BOOST_CHECK_GT(device.getCapacity(), 0);
+        BOOST_CHECK_GE(best.getCapacity(), device.getCapacity());
+
+        if (i > 0)
+            BOOST_CHECK_GE(system.getDevice(i - 1).getCapacity(), device.getCapacity());
+    }
+
+    const size_t last = system.getDeviceCount() - 1;
+    system.setPreferredDevice(std::to_string(last));
+    BOOST_CHECK_EQUAL(&system.getBestDevice(), &system.getDevice(last));
+
+    system.setPreferredDevice(best.getName().c_str());
+    BOOST_CHECK_EQUAL(system.getBestDevice().getName(), best.getName());
+
+    system.setPreferredDevice("no such OpenCL device");
+    BOOST_CHECK_THROW(system.getBestDevice(), std::invalid_argument);
+
+    system.setPreferredDevice(std::to_string(system.getDeviceCount()));
+    BOOST_CHECK_THROW(system.getBestDevice(), std::invalid_argument);
+
+    system.setPreferredDevice("99999999999999999999999999");
+    BOOST_CHECK_THROW(system.getBestDevice(), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(CalibrateDevices)
+{
+    oclcrypto::System system(true);
+    const size_t deviceCount = system.getDeviceCount();
+    BOOST_REQUIRE_GT(deviceCount, 0);
+
+    system.calibrateDevices(64 * 1024);
+    BOOST_CHECK_EQUAL(system.getDeviceCount(), deviceCount);
+
+    for (size_t i = 1; i < system.getDeviceCount(); ++i)
+        BOOST_CHECK_GE(system.getDevice(i - 1).getCapacity(), system.getDevice(i).getCapacity());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
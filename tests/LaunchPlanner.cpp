@@ -0,0 +1,147 @@
+/*
+ * Copyright (C) 2015 Martin Preisler <martin@preisler.me>
+ *
+ * This file is part of oclcrypto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <oclcrypto/LaunchPlanner.h>
+#include <oclcrypto/System.h>
+#include <oclcrypto/Device.h>
+#include <oclcrypto/AES_ECB.h>
+#include <oclcrypto/DataBuffer.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(LaunchPlanner)
+
+BOOST_AUTO_TEST_CASE(BoundsChecked)
+{
+    // rounded up to whole work-groups
+    oclcrypto::LaunchPlanner::LaunchList launches = oclcrypto::LaunchPlanner::plan(1000, 64, true);
+    BOOST_REQUIRE_EQUAL(launches.size(), 1);
+    BOOST_CHECK_EQUAL(launches[0].offset, 0);
+    BOOST_CHECK_EQUAL(launches[0].globalWorkSize, 1024);
+    BOOST_CHECK_EQUAL(launches[0].localWorkSize, 64);
+
+    // implementation's choice needs the exact count
+    launches = oclcrypto::LaunchPlanner::plan(1000, 0, true);
+    BOOST_REQUIRE_EQUAL(launches.size(), 1);
+    BOOST_CHECK_EQUAL(launches[0].globalWorkSize, 1000);
+    BOOST_CHECK_EQUAL(launches[0].localWorkSize, 0);
+
+    BOOST_CHECK(oclcrypto::LaunchPlanner::plan(0, 64, true).empty());
+}
+
+BOOST_AUTO_TEST_CASE(Unchecked)
+{
+    // the local size is lowered to the greatest common divisor
+    const oclcrypto::LaunchPlanner::LaunchList launches = oclcrypto::LaunchPlanner::plan(1000, 64, false);
+    BOOST_REQUIRE_EQUAL(launches.size(), 1);
+    BOOST_CHECK_EQUAL(launches[0].globalWorkSize, 1000);
+    BOOST_CHECK_EQUAL(launches[0].localWorkSize, 8);
+}
+
+BOOST_AUTO_TEST_CASE(Split)
+{
+    // 100 items in launches of at most 30, every launch but the last made of whole groups of 8
+    oclcrypto::LaunchPlanner::LaunchList launches = oclcrypto::LaunchPlanner::plan(100, 8, true, 30);
+    BOOST_REQUIRE_EQUAL(launches.size(), 5);
+
+    size_t covered = 0;
+    for (size_t i = 0; i < launches.size(); ++i)
+    {
+        BOOST_CHECK_EQUAL(launches[i].offset, covered);
+        BOOST_CHECK_EQUAL(launches[i].globalWorkSize % 8, 0);
+        BOOST_CHECK_EQUAL(launches[i].localWorkSize, 8);
+        covered += launches[i].globalWorkSize;
+    }
+    BOOST_CHECK_EQUAL(launches[0].globalWorkSize, 24);
+    BOOST_CHECK_EQUAL(covered, 104);
+
+    // a 4 GiB AES input fits one launch of the default size
+    launches = oclcrypto::LaunchPlanner::plan(static_cast<size_t>(1) << 28, 256, true);
+    BOOST_CHECK_EQUAL(launches.size(), 1);
+
+    // and takes 4 launches of 2^26 work items
+    launches = oclcrypto::LaunchPlanner::plan(static_cast<size_t>(1) << 28, 256, true,
+                                              static_cast<size_t>(1) << 26);
+    BOOST_CHECK_EQUAL(launches.size(), 4);
+    BOOST_CHECK_EQUAL(launches.back().offset, static_cast<size_t>(3) << 26);
+
+    // 2^32 work items are split at the default launch size
+    if (sizeof(size_t) > 4)
+    {
+        const size_t maxLaunchSize = oclcrypto::LaunchPlanner::DefaultMaxLaunchSize;
+        launches = oclcrypto::LaunchPlanner::plan(2 * maxLaunchSize, 256, true);
+        BOOST_CHECK_EQUAL(launches.size(), 2);
+        BOOST_CHECK_EQUAL(launches.back().offset, maxLaunchSize);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(OddBlockCount)
+{
+    const unsigned char plaintext[] =
+    {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+        0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+    };
+
+    const unsigned char key[] =
+    {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+    };
+
+    const unsigned char expected_ciphertext[] =
+    {
+        0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+        0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+    };
+
+    // 7 blocks don't fill a single work-group of 4, the extra item has to stay idle
+    const size_t blocks = 7;
+    std::vector<unsigned char> input;
+    for (size_t i = 0; i < blocks; ++i)
+        input.insert(input.end(), plaintext, plaintext + 16);
+
+    oclcrypto::System system(true);
+
+    for (size_t i = 0; i < system.getDeviceCount(); ++i)
+    {
+        oclcrypto::Device& device = system.getDevice(i);
+
+        oclcrypto::AES_ECB_Encrypt encrypt(system, device);
+        encrypt.setKey(key, 16);
+        encrypt.setPlainText(input.data(), input.size());
+        encrypt.execute(4).wait();
+
+        auto data = encrypt.getCipherText()->lockRead<unsigned char>();
+        BOOST_REQUIRE_EQUAL(data.size(), input.size());
+        for (size_t j = 0; j < blocks; ++j)
+            BOOST_CHECK_EQUAL_COLLECTIONS(data.begin() + j * 16, data.begin() + (j + 1) * 16,
+                                          expected_ciphertext, expected_ciphertext + 16);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
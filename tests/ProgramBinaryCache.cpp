@@ -0,0 +1,149 @@
+/*
+ * Copyright (C) 2015 Martin Preisler <martin@preisler.me>
+ *
+ * This file is part of oclcrypto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <oclcrypto/ProgramBinaryCache.h>
+#include <oclcrypto/System.h>
+#include <oclcrypto/Device.h>
+#include <oclcrypto/Program.h>
+#include <oclcrypto/AES_ECB.h>
+#include <oclcrypto/DataBuffer.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const std::string cacheDirectory = "oclcrypto-tests-program-cache";
+
+}
+
+BOOST_AUTO_TEST_SUITE(ProgramBinaryCache)
+
+BOOST_AUTO_TEST_CASE(Hash)
+{
+    // reference values of 64bit FNV-1a
+    BOOST_CHECK_EQUAL(oclcrypto::ProgramBinaryCache::hash(""), 0xcbf29ce484222325ULL);
+    BOOST_CHECK_EQUAL(oclcrypto::ProgramBinaryCache::hash("a"), 0xaf63dc4c8601ec8cULL);
+    BOOST_CHECK_NE(oclcrypto::ProgramBinaryCache::hash("abc"), oclcrypto::ProgramBinaryCache::hash("acb"));
+}
+
+BOOST_AUTO_TEST_CASE(StoreAndLoad)
+{
+    oclcrypto::ProgramBinaryCache cache(cacheDirectory);
+    BOOST_CHECK_EQUAL(cache.getDirectory(), cacheDirectory);
+
+    const std::string key = "device: test\nsource: StoreAndLoad\n";
+    cache.remove(key);
+
+    std::vector<unsigned char> binary;
+    binary.push_back(42);
+    BOOST_CHECK(!cache.load(key, binary));
+    // failed loads leave the output alone
+    BOOST_CHECK_EQUAL(binary.size(), 1);
+
+    std::vector<unsigned char> stored(1000);
+    for (size_t i = 0; i < stored.size(); ++i)
+        stored[i] = static_cast<unsigned char>(i * 7);
+
+    BOOST_REQUIRE(cache.store(key, stored));
+    BOOST_REQUIRE(cache.load(key, binary));
+    BOOST_CHECK_EQUAL_COLLECTIONS(binary.begin(), binary.end(), stored.begin(), stored.end());
+
+    BOOST_CHECK(!cache.load(key + "different", binary));
+
+    BOOST_CHECK(cache.remove(key));
+    BOOST_CHECK(!cache.load(key, binary));
+}
+
+BOOST_AUTO_TEST_CASE(ReuseAcrossSystems)
+{
+    const unsigned char plaintext[] =
+    {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+        0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+    };
+
+    const unsigned char key[] =
+    {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+    };
+
+    const unsigned char expected_ciphertext[] =
+    {
+        0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+        0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+    };
+
+    std::vector<std::string> keys;
+
+    {
+        oclcrypto::System system(true);
+        BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+        system.setProgramBinaryCacheDirectory(cacheDirectory);
+        BOOST_REQUIRE(system.getProgramBinaryCache());
+
+        for (size_t i = 0; i < system.getDeviceCount(); ++i)
+        {
+            oclcrypto::Device& device = system.getDevice(i);
+            oclcrypto::Program& program = system.getProgramFromCache(device, oclcrypto::ProgramSources::AES);
+            keys.push_back(oclcrypto::ProgramBinaryCache::makeKey(device, program.getBuildOptions(), program.getSource()));
+        }
+    }
+
+    {
+        oclcrypto::System system(true);
+        system.setProgramBinaryCacheDirectory(cacheDirectory);
+
+        for (size_t i = 0; i < system.getDeviceCount(); ++i)
+        {
+            oclcrypto::Device& device = system.getDevice(i);
+            oclcrypto::Program& program = system.getProgramFromCache(device, oclcrypto::ProgramSources::AES);
+            BOOST_CHECK(program.isFromBinaryCache());
+
+            // the cached binary has to work just like the one built from source
+            oclcrypto::AES_ECB_Encrypt encrypt(system, device);
+            encrypt.setKey(key, 16);
+            encrypt.setPlainText(plaintext, 16);
+            encrypt.execute(1);
+
+            auto data = encrypt.getCipherText()->lockRead<unsigned char>();
+            BOOST_CHECK_EQUAL_COLLECTIONS(data.begin(), data.end(), expected_ciphertext, expected_ciphertext + 16);
+        }
+
+        // disabling the cache must not affect programs created already
+        system.setProgramBinaryCacheDirectory("");
+        BOOST_CHECK(!system.getProgramBinaryCache());
+    }
+
+    oclcrypto::ProgramBinaryCache cache(cacheDirectory);
+    for (size_t i = 0; i < keys.size(); ++i)
+        cache.remove(keys[i]);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -29,6 +29,9 @@
 #include <oclcrypto/Kernel.h>
 #include <oclcrypto/CLError.h>
 
+#include <algorithm>
+#include <vector>
+
 #include <boost/test/unit_test.hpp>
 
 struct RawOpenCLFixture
@@ -167,6 +170,315 @@ BOOST_AUTO_TEST_CASE(DataBuffers)
     }
 }
 
+BOOST_AUTO_TEST_CASE(DataBuffersAsync)
+{
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+
+    for (size_t i = 0; i < system.getDeviceCount(); ++i)
+    {
+        oclcrypto::Device& device = system.getDevice(i);
+
+        oclcrypto::DataBuffer& buffer = device.allocateBuffer<int>(16, oclcrypto::DataBuffer::ReadWrite);
+
+        {
+            auto data = buffer.lockWriteAsync<int>();
+            // the first access blocks until the mapping is done
+            for (int j = 0; j < 16; ++j)
+                data[j] = j;
+        }
+        {
+            auto data = buffer.lockReadAsync<int>();
+            data.wait();
+            for (int j = 0; j < 16; ++j)
+                BOOST_CHECK_EQUAL(data[j], j);
+        }
+
+        {
+            oclcrypto::Event mapEvent;
+            int* data = static_cast<int*>(buffer.mapForReadingAsync(mapEvent));
+            mapEvent.wait();
+            BOOST_CHECK(mapEvent.isComplete());
+            BOOST_CHECK_EQUAL(data[15], 15);
+
+            oclcrypto::Event unmapEvent;
+            buffer.unmapAsync(data, unmapEvent);
+            unmapEvent.wait();
+            BOOST_CHECK(unmapEvent.isComplete());
+        }
+
+        device.deallocateBuffer(buffer);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(DataBuffersRanged)
+{
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+
+    for (size_t i = 0; i < system.getDeviceCount(); ++i)
+    {
+        oclcrypto::Device& device = system.getDevice(i);
+
+        oclcrypto::DataBuffer& buffer = device.allocateBuffer<int>(64, oclcrypto::DataBuffer::ReadWrite);
+
+        {
+            auto data = buffer.lockWrite<int>();
+            for (int j = 0; j < 64; ++j)
+                data[j] = j;
+        }
+        {
+            auto data = buffer.lockWrite<int>(16, 8);
+            BOOST_CHECK_EQUAL(data.size(), 8);
+            for (int j = 0; j < 8; ++j)
+                data[j] = -j;
+        }
+        {
+            auto data = buffer.lockRead<int>(12, 16);
+            BOOST_CHECK_EQUAL(data.size(), 16);
+            for (int j = 0; j < 4; ++j)
+                BOOST_CHECK_EQUAL(data[j], 12 + j);
+            for (int j = 4; j < 12; ++j)
+                BOOST_CHECK_EQUAL(data[j], 4 - j);
+            for (int j = 12; j < 16; ++j)
+                BOOST_CHECK_EQUAL(data[j], 12 + j);
+        }
+        {
+            auto data = buffer.lockReadAsync<int>(63, 1);
+            BOOST_CHECK_EQUAL(data[0], 63);
+        }
+
+        BOOST_CHECK_THROW(buffer.lockRead<int>(60, 5), std::out_of_range);
+        BOOST_CHECK_THROW(buffer.lockWrite<int>(0, 0), std::invalid_argument);
+
+        device.deallocateBuffer(buffer);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(DataBuffersOverwrite)
+{
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+
+    for (size_t i = 0; i < system.getDeviceCount(); ++i)
+    {
+        oclcrypto::Device& device = system.getDevice(i);
+        BOOST_CHECK(device.supportsCLVersion(1, 0));
+        BOOST_CHECK(!device.supportsCLVersion(99, 0));
+
+        oclcrypto::DataBuffer& buffer = device.allocateBuffer<int>(32, oclcrypto::DataBuffer::ReadWrite);
+
+        {
+            auto data = buffer.lockOverwrite<int>();
+            for (int j = 0; j < 32; ++j)
+                data[j] = j;
+        }
+        {
+            // only the overwritten range is discarded, the rest has to stay intact
+            auto data = buffer.lockOverwrite<int>(8, 8);
+            for (int j = 0; j < 8; ++j)
+                data[j] = -1;
+        }
+        {
+            auto data = buffer.lockRead<int>();
+            for (int j = 0; j < 32; ++j)
+                BOOST_CHECK_EQUAL(data[j], (j >= 8 && j < 16) ? -1 : j);
+        }
+
+        device.deallocateBuffer(buffer);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(DataBuffersTransfer)
+{
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+
+    std::vector<int> input(32);
+    for (size_t j = 0; j < input.size(); ++j)
+        input[j] = static_cast<int>(j) * 3;
+
+    for (size_t i = 0; i < system.getDeviceCount(); ++i)
+    {
+        oclcrypto::Device& device = system.getDevice(i);
+
+        oclcrypto::DataBuffer& buffer = device.allocateBuffer<int>(32, oclcrypto::DataBuffer::ReadWrite);
+        buffer.write(input.data(), input.size() * sizeof(int));
+
+        {
+            std::vector<int> output(32, 0);
+            buffer.read(output.data(), output.size() * sizeof(int));
+            BOOST_CHECK_EQUAL_COLLECTIONS(output.begin(), output.end(), input.begin(), input.end());
+        }
+        {
+            // only touch the second half
+            const int zeros[16] = {0};
+            oclcrypto::Event event;
+            buffer.writeAsync(zeros, sizeof(zeros), 16 * sizeof(int), event);
+            event.wait();
+
+            std::vector<int> output(16, -1);
+            buffer.readAsync(output.data(), output.size() * sizeof(int), 8 * sizeof(int), event);
+            event.wait();
+            for (size_t j = 0; j < 8; ++j)
+                BOOST_CHECK_EQUAL(output[j], input[8 + j]);
+            for (size_t j = 8; j < 16; ++j)
+                BOOST_CHECK_EQUAL(output[j], 0);
+        }
+        {
+            auto data = buffer.lockWrite<int>();
+            std::copy(input.begin(), input.end(), data.begin());
+        }
+        {
+            auto data = buffer.lockRead<int>();
+            BOOST_CHECK_EQUAL(data.end() - data.begin(), 32);
+            BOOST_CHECK_EQUAL_COLLECTIONS(data.begin(), data.end(), input.begin(), input.end());
+        }
+
+        int dummy[2];
+        BOOST_CHECK_THROW(buffer.read(dummy, sizeof(dummy), 31 * sizeof(int)), std::out_of_range);
+
+        device.deallocateBuffer(buffer);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(DataBufferViews)
+{
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+
+    for (size_t i = 0; i < system.getDeviceCount(); ++i)
+    {
+        oclcrypto::Device& device = system.getDevice(i);
+
+        const size_t align = device.getMemBaseAddrAlign();
+        oclcrypto::DataBuffer& buffer = device.allocateBuffer<unsigned char>(4 * align, oclcrypto::DataBuffer::ReadWrite);
+
+        {
+            auto data = buffer.lockWrite<unsigned char>();
+            for (size_t j = 0; j < data.size(); ++j)
+                data[j] = static_cast<unsigned char>(j);
+        }
+
+        oclcrypto::DataBuffer& view = buffer.createView(align, 2 * align);
+        BOOST_CHECK(view.isView());
+        BOOST_CHECK_EQUAL(view.getParent(), &buffer);
+        BOOST_CHECK_EQUAL(view.getSize(), 2 * align);
+        BOOST_CHECK_EQUAL(buffer.getViewCount(), 1);
+
+        {
+            auto data = view.lockRead<unsigned char>();
+            for (size_t j = 0; j < data.size(); ++j)
+                BOOST_CHECK_EQUAL(data[j], static_cast<unsigned char>(align + j));
+        }
+        {
+            auto data = view.lockWrite<unsigned char>();
+            data[0] = 0xff;
+        }
+        {
+            auto data = buffer.lockRead<unsigned char>(align, 1);
+            BOOST_CHECK_EQUAL(data[0], 0xff);
+        }
+
+        // views of views are created over the outermost parent
+        oclcrypto::DataBuffer& nested = view.createView(align, align);
+        BOOST_CHECK_EQUAL(nested.getParent(), &buffer);
+        BOOST_CHECK_EQUAL(nested.getViewOffset(), 2 * align);
+        BOOST_CHECK_EQUAL(buffer.getViewCount(), 2);
+
+        BOOST_CHECK_THROW(buffer.createView(3 * align, 2 * align), std::out_of_range);
+        if (align > 1)
+            BOOST_CHECK_THROW(buffer.createView(1, align), std::invalid_argument);
+
+        BOOST_CHECK_THROW(device.deallocateBuffer(buffer), std::runtime_error);
+
+        device.deallocateBuffer(nested);
+        device.deallocateBuffer(view);
+        BOOST_CHECK_EQUAL(buffer.getViewCount(), 0);
+        device.deallocateBuffer(buffer);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(BufferPoolRecycling)
+{
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+
+    for (size_t i = 0; i < system.getDeviceCount(); ++i)
+    {
+        oclcrypto::Device& device = system.getDevice(i);
+        oclcrypto::BufferPool& pool = device.getBufferPool();
+
+        BOOST_CHECK_EQUAL(pool.getSizeClass(1), oclcrypto::BufferPool::MinimumSizeClass);
+        BOOST_CHECK_EQUAL(pool.getSizeClass(4096), 4096);
+        BOOST_CHECK_EQUAL(pool.getSizeClass(4097), 8192);
+
+        {
+            oclcrypto::DataBuffer& buffer = device.allocateBuffer<unsigned char>(3000, oclcrypto::DataBuffer::Read);
+            BOOST_CHECK_EQUAL(buffer.getSize(), 3000);
+            BOOST_CHECK_EQUAL(buffer.getCapacity(), 4096);
+            device.deallocateBuffer(buffer);
+        }
+
+        const size_t allocations = pool.getDriverAllocationCount();
+        BOOST_CHECK_GE(pool.getCachedBytes(), 4096);
+
+        // different sizes in the same size class have to be served from the pool
+        for (size_t size = 2049; size <= 4096; size += 509)
+        {
+            oclcrypto::DataBuffer& buffer = device.allocateBuffer<unsigned char>(size, oclcrypto::DataBuffer::Read);
+            BOOST_CHECK_EQUAL(buffer.getSize(), size);
+            device.deallocateBuffer(buffer);
+        }
+
+        BOOST_CHECK_EQUAL(pool.getDriverAllocationCount(), allocations);
+
+        pool.trim();
+        BOOST_CHECK_EQUAL(pool.getCachedBytes(), 0);
+
+        pool.setHighWaterMark(0);
+        {
+            oclcrypto::DataBuffer& buffer = device.allocateBuffer<unsigned char>(3000, oclcrypto::DataBuffer::Read);
+            device.deallocateBuffer(buffer);
+        }
+        BOOST_CHECK_EQUAL(pool.getCachedBytes(), 0);
+        pool.setHighWaterMark(oclcrypto::BufferPool::DefaultHighWaterMark);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(MemoryAccounting)
+{
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+
+    for (size_t i = 0; i < system.getDeviceCount(); ++i)
+    {
+        oclcrypto::Device& device = system.getDevice(i);
+        BOOST_CHECK_GT(device.getGlobalMemSize(), 0);
+        BOOST_CHECK_GT(device.getMaxMemAllocSize(), 0);
+        BOOST_CHECK_EQUAL(device.getMemoryBudget(), device.getGlobalMemSize());
+
+        const size_t liveBytes = device.getLiveBytes();
+        const size_t allocations = device.getAllocationCount();
+
+        oclcrypto::DataBuffer& buffer = device.allocateBuffer<unsigned char>(4096);
+        BOOST_CHECK_EQUAL(device.getLiveBytes(), liveBytes + buffer.getCapacity());
+        BOOST_CHECK_GE(device.getPeakBytes(), device.getLiveBytes());
+        BOOST_CHECK_EQUAL(device.getAllocationCount(), allocations + 1);
+
+        // the budget only allows what is live already
+        device.setMemoryBudget(device.getLiveBytes());
+        BOOST_CHECK_THROW(device.allocateBuffer<unsigned char>(4096), oclcrypto::DeviceMemoryBudgetExceeded);
+        BOOST_CHECK_EQUAL(device.getAllocationCount(), allocations + 1);
+
+        device.deallocateBuffer(buffer);
+        BOOST_CHECK_EQUAL(device.getLiveBytes(), liveBytes);
+
+        // freed memory can be reused without exceeding the budget
+        const size_t driverAllocations = device.getBufferPool().getDriverAllocationCount();
+        oclcrypto::DataBuffer& again = device.allocateBuffer<unsigned char>(4096);
+        BOOST_CHECK_EQUAL(device.getBufferPool().getDriverAllocationCount(), driverAllocations);
+        device.deallocateBuffer(again);
+
+        device.setMemoryBudget(device.getGlobalMemSize());
+        BOOST_CHECK_THROW(device.setMemoryBudget(device.getGlobalMemSize() + 1), std::invalid_argument);
+        BOOST_CHECK_THROW(device.allocateBufferRaw(device.getMaxMemAllocSize() + 1), oclcrypto::DeviceMemoryBudgetExceeded);
+    }
+}
+
 BOOST_AUTO_TEST_CASE(KernelExecutionSetToConstant)
 {
     BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
@@ -278,4 +590,57 @@ BOOST_AUTO_TEST_CASE(KernelExecutionSquareInPlace)
     }
 }
 
+BOOST_AUTO_TEST_CASE(KernelExecutionEventChain)
+{
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+
+    for (size_t i = 0; i < system.getDeviceCount(); ++i)
+    {
+        oclcrypto::Device& device = system.getDevice(i);
+        device.setProfilingEnabled(true);
+        BOOST_CHECK(device.isProfilingEnabled());
+
+        oclcrypto::ScopedProgram program = device.createProgram(opencl_sample_code);
+        {
+            std::vector<int> input(16);
+            for (int j = 0; j < 16; ++j)
+                input[j] = j;
+
+            oclcrypto::DataBuffer& io = device.allocateBuffer<int>(16, oclcrypto::DataBuffer::ReadWrite);
+            oclcrypto::ScopedKernel kernel = program->createKernel("square_in_place");
+            kernel->setParameter(0, io);
+
+            // upload -> square -> readback without waiting on the host in between
+            oclcrypto::Event uploaded;
+            io.writeAsync(input.data(), 16 * sizeof(int), 0, uploaded);
+
+            oclcrypto::EventList waitList;
+            waitList.push_back(uploaded);
+            oclcrypto::Event squared = kernel->execute(16, 1, false, waitList);
+
+            std::vector<int> output(16);
+            oclcrypto::Event downloaded;
+            io.readAsync(output.data(), 16 * sizeof(int), 0, downloaded, oclcrypto::EventList(1, squared));
+
+            downloaded.wait();
+            BOOST_CHECK(downloaded.isComplete());
+            BOOST_CHECK(squared.isComplete());
+
+            for (size_t j = 0; j < 16; ++j)
+                BOOST_CHECK_EQUAL(output[j], j * j);
+
+            BOOST_CHECK_LE(squared.getQueuedTime(), squared.getSubmitTime());
+            BOOST_CHECK_LE(squared.getSubmitTime(), squared.getStartTime());
+            BOOST_CHECK_LE(squared.getStartTime(), squared.getEndTime());
+            BOOST_CHECK_EQUAL(squared.getDuration(), squared.getEndTime() - squared.getStartTime());
+
+            // blocking execute returns a completed event
+            BOOST_CHECK(kernel->execute(16, 1).isComplete());
+        }
+
+        BOOST_CHECK_THROW(oclcrypto::Event().getStartTime(), std::runtime_error);
+        device.setProfilingEnabled(false);
+    }
+}
+
 BOOST_AUTO_TEST_SUITE_END()
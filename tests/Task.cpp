@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2015 Martin Preisler <martin@preisler.me>
+ *
+ * This file is part of oclcrypto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <oclcrypto/Task.h>
+#include <oclcrypto/TaskScheduler.h>
+#include <oclcrypto/System.h>
+#include <oclcrypto/Device.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+BOOST_AUTO_TEST_SUITE(Task)
+
+BOOST_AUTO_TEST_CASE(Passthrough)
+{
+    oclcrypto::System system(true);
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+
+    std::vector<unsigned char> input(1000);
+    for (size_t i = 0; i < input.size(); ++i)
+        input[i] = static_cast<unsigned char>(i * 13);
+
+    oclcrypto::TaskPtr task(new oclcrypto::Task(oclcrypto::TA_PASSTHROUGH, input));
+    BOOST_CHECK_EQUAL(task->getState(), oclcrypto::TS_SPECIFIED);
+    BOOST_CHECK(!task->getDevice());
+    BOOST_CHECK_THROW(task->getOutput(), std::runtime_error);
+
+    system.submit(task)->wait();
+
+    BOOST_REQUIRE_EQUAL(task->getState(), oclcrypto::TS_FINISHED);
+    BOOST_CHECK(task->getDevice());
+    BOOST_CHECK_EQUAL_COLLECTIONS(task->getOutput().begin(), task->getOutput().end(), input.begin(), input.end());
+
+    // tasks run only once
+    BOOST_CHECK_THROW(system.submit(task), std::invalid_argument);
+}
+
+BOOST_AUTO_TEST_CASE(ManyTasks)
+{
+    const unsigned char plaintext[] =
+    {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+        0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+    };
+
+    const unsigned char key[] =
+    {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+    };
+
+    const unsigned char expected_ciphertext[] =
+    {
+        0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+        0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+    };
+
+    const size_t blocks = 64;
+    std::vector<unsigned char> input;
+    std::vector<unsigned char> expected;
+    for (size_t i = 0; i < blocks; ++i)
+    {
+        input.insert(input.end(), plaintext, plaintext + 16);
+        expected.insert(expected.end(), expected_ciphertext, expected_ciphertext + 16);
+    }
+
+    oclcrypto::System system(true);
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+    BOOST_CHECK_GT(system.getTaskScheduler().getWorkerCount(), 0);
+
+    std::atomic<size_t> completed(0);
+    std::vector<oclcrypto::TaskPtr> tasks;
+
+    for (int i = 0; i < 32; ++i)
+    {
+        oclcrypto::TaskPtr task(new oclcrypto::Task(oclcrypto::TA_AES_ECB_ENCRYPT, input,
+                                                    std::vector<unsigned char>(key, key + 16)));
+        task->setCallback([&completed](oclcrypto::Task& task)
+        {
+            if (task.getState() == oclcrypto::TS_FINISHED)
+                ++completed;
+        });
+
+        tasks.push_back(system.submit(task));
+    }
+
+    system.getTaskScheduler().waitIdle();
+    BOOST_CHECK_EQUAL(completed.load(), tasks.size());
+    BOOST_CHECK_EQUAL(system.getTaskScheduler().getQueuedCount(), 0);
+
+    for (size_t i = 0; i < tasks.size(); ++i)
+    {
+        BOOST_REQUIRE_EQUAL(tasks[i]->getState(), oclcrypto::TS_FINISHED);
+        BOOST_CHECK_EQUAL_COLLECTIONS(tasks[i]->getOutput().begin(), tasks[i]->getOutput().end(),
+                                      expected.begin(), expected.end());
+        BOOST_CHECK_EQUAL(system.getTaskScheduler().getDeviceLoad(*tasks[i]->getDevice()), 0);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(Failure)
+{
+    oclcrypto::System system(true);
+    BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+
+    // 5 byte key is invalid for AES
+    oclcrypto::TaskPtr task(new oclcrypto::Task(oclcrypto::TA_AES_ECB_ENCRYPT,
+                                                std::vector<unsigned char>(16),
+                                                std::vector<unsigned char>(5)));
+
+    bool called = false;
+    task->setCallback([&called](oclcrypto::Task&) { called = true; });
+
+    system.submit(task)->wait();
+
+    BOOST_CHECK_EQUAL(task->getState(), oclcrypto::TS_ERROR);
+    BOOST_CHECK(task->getError());
+    BOOST_CHECK_THROW(task->getOutput(), std::invalid_argument);
+    BOOST_CHECK(called);
+
+    BOOST_CHECK_THROW(task->setCallback(oclcrypto::Task::Callback()), std::runtime_error);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,136 @@
+/*
+ * Copyright (C) 2015 Martin Preisler <martin@preisler.me>
+ *
+ * This file is part of oclcrypto.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS BE LIABLE FOR ANY CLAIM, DAMAGES OR
+ * OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE,
+ * ARISING FROM, OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR
+ * OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <oclcrypto/WorkGroupTuner.h>
+#include <oclcrypto/ProgramBinaryCache.h>
+#include <oclcrypto/System.h>
+#include <oclcrypto/Device.h>
+#include <oclcrypto/Kernel.h>
+#include <oclcrypto/Program.h>
+#include <oclcrypto/AES_ECB.h>
+#include <oclcrypto/DataBuffer.h>
+
+#include <boost/test/unit_test.hpp>
+
+#include <string>
+#include <vector>
+
+namespace
+{
+
+const std::string cacheDirectory = "oclcrypto-tests-work-group-sizes";
+
+}
+
+BOOST_AUTO_TEST_SUITE(WorkGroupTuner)
+
+BOOST_AUTO_TEST_CASE(Candidates)
+{
+    const std::vector<size_t> candidates = oclcrypto::WorkGroupTuner::getCandidates(256, 32);
+    const size_t expected[] = {0, 32, 64, 128, 256};
+    BOOST_CHECK_EQUAL_COLLECTIONS(candidates.begin(), candidates.end(), expected, expected + 5);
+
+    // limited to 1024 even if the device allows more
+    BOOST_CHECK_EQUAL(oclcrypto::WorkGroupTuner::getCandidates(8192, 1).back(), 1024);
+    // a kernel that can't run with its preferred multiple still gets the implementation's choice
+    BOOST_CHECK_EQUAL(oclcrypto::WorkGroupTuner::getCandidates(16, 32).size(), 1);
+}
+
+BOOST_AUTO_TEST_CASE(TuneAndPersist)
+{
+    const unsigned char plaintext[] =
+    {
+        0x00, 0x11, 0x22, 0x33, 0x44, 0x55, 0x66, 0x77,
+        0x88, 0x99, 0xaa, 0xbb, 0xcc, 0xdd, 0xee, 0xff
+    };
+
+    const unsigned char key[] =
+    {
+        0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+        0x08, 0x09, 0x0a, 0x0b, 0x0c, 0x0d, 0x0e, 0x0f
+    };
+
+    const unsigned char expected_ciphertext[] =
+    {
+        0x69, 0xc4, 0xe0, 0xd8, 0x6a, 0x7b, 0x04, 0x30,
+        0xd8, 0xcd, 0xb7, 0x80, 0x70, 0xb4, 0xc5, 0x5a
+    };
+
+    std::vector<oclcrypto::Device::LocalWorkSizeMap> tuned;
+
+    {
+        oclcrypto::System system(true);
+        BOOST_REQUIRE_GT(system.getDeviceCount(), 0);
+        system.setProgramBinaryCacheDirectory(cacheDirectory);
+
+        oclcrypto::WorkGroupTuner tuner(system);
+        tuner.tune(16 * 1024);
+
+        for (size_t i = 0; i < system.getDeviceCount(); ++i)
+        {
+            oclcrypto::Device& device = system.getDevice(i);
+            const oclcrypto::Device::LocalWorkSizeMap sizes = device.getTunedLocalWorkSizes();
+            // 4 AES kernels in 3 key sizes times 2 implementations, ECB and CTR
+            // encryption bitsliced in 3 key sizes and BLOWFISH
+            BOOST_CHECK_EQUAL(sizes.size(), 31);
+            tuned.push_back(sizes);
+
+            oclcrypto::Program& program = system.getProgramFromCache(device, oclcrypto::ProgramSources::BLOWFISH);
+            oclcrypto::ScopedKernel kernel(program.createKernel("BLOWFISH_ECB_Encrypt"));
+            BOOST_CHECK_LE(kernel->suggestLocalWorkSize(), kernel->getWorkGroupSize());
+            BOOST_CHECK_EQUAL(kernel->suggestLocalWorkSize(), device.suggestLocalWorkSize("BLOWFISH_ECB_Encrypt"));
+
+            // whatever was tuned, a single block still has to work
+            oclcrypto::AES_ECB_Encrypt encrypt(system, device);
+            encrypt.setKey(key, 16);
+            encrypt.setPlainText(plaintext, 16);
+            encrypt.execute();
+
+            auto data = encrypt.getCipherText()->lockRead<unsigned char>();
+            BOOST_CHECK_EQUAL_COLLECTIONS(data.begin(), data.end(), expected_ciphertext, expected_ciphertext + 16);
+        }
+    }
+
+    {
+        oclcrypto::System system(true);
+        system.setProgramBinaryCacheDirectory(cacheDirectory);
+
+        oclcrypto::ProgramBinaryCache& cache = *system.getProgramBinaryCache();
+        for (size_t i = 0; i < system.getDeviceCount(); ++i)
+        {
+            oclcrypto::Device& device = system.getDevice(i);
+            // devices are ordered by capacity in both systems, they match
+            BOOST_CHECK(device.getTunedLocalWorkSizes() == tuned[i]);
+
+            device.setTunedLocalWorkSizes(oclcrypto::Device::LocalWorkSizeMap());
+            BOOST_CHECK_EQUAL(device.suggestLocalWorkSize("AES_ECB_Encrypt", "-D AES_ROUNDS=11"), device.suggestLocalWorkSize());
+
+            // clean up after ourselves by overwriting the entry with an empty one
+            BOOST_CHECK(oclcrypto::WorkGroupTuner::store(device, cache));
+        }
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()